@@ -0,0 +1,143 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lorinterface/brightness.h"
+#include "lorinterface/duration.h"
+
+// libreorama_bench_fixed verifies the integer intensity conversion against its float equivalent
+//  across the full input range, and times both the intensity & duration conversions
+// the float & fixed conversions must be identical for LIBREORAMA_FIXED_POINT to be enabled safely
+// the duration table is built from the float conversion itself (see #duration_table_init), so it is only timed
+
+#define BENCH_ITERATIONS 200
+
+static unsigned long long bench_ns_since(const struct timespec *start_time) {
+    struct timespec stop_time;
+
+    clock_gettime(CLOCK_MONOTONIC, &stop_time);
+
+    return (unsigned long long) (stop_time.tv_sec - start_time->tv_sec) * 1000000000ull + (unsigned long long) (stop_time.tv_nsec - start_time->tv_nsec);
+}
+
+static unsigned long verify_intensity(void) {
+    unsigned long mismatches = 0;
+
+    for (unsigned int intensity = 0; intensity <= BRIGHTNESS_MAX_INTENSITY; intensity++) {
+        const unsigned char fixed = BRIGHTNESS_OF_INTENSITY_FIXED(intensity);
+        const unsigned char fl    = BRIGHTNESS_OF_INTENSITY_FLOAT(intensity);
+
+        if (fixed != fl) {
+            printf("intensity mismatch: %u (fixed %u, float %u)\n", intensity, fixed, fl);
+            mismatches++;
+        }
+    }
+
+    return mismatches;
+}
+
+static void bench_intensity(void) {
+    // volatile sinks prevent the conversions from being optimized away
+    volatile unsigned char sink;
+    struct timespec        start_time;
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        for (volatile unsigned int intensity = 0; intensity <= BRIGHTNESS_MAX_INTENSITY; intensity++) {
+            sink = BRIGHTNESS_OF_INTENSITY_FIXED(intensity);
+        }
+    }
+
+    const unsigned long long fixed_ns = bench_ns_since(&start_time);
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        for (volatile unsigned int intensity = 0; intensity <= BRIGHTNESS_MAX_INTENSITY; intensity++) {
+            sink = BRIGHTNESS_OF_INTENSITY_FLOAT(intensity);
+        }
+    }
+
+    const unsigned long long float_ns = bench_ns_since(&start_time);
+    const double             count    = (double) BENCH_ITERATIONS * (BRIGHTNESS_MAX_INTENSITY + 1);
+
+    (void) sink;
+
+    printf("%-12s %12.2f %12.2f\n", "intensity", (double) fixed_ns / count, (double) float_ns / count);
+}
+
+static void bench_duration(void) {
+    volatile lor_duration_t sink;
+    struct timespec         start_time;
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        for (volatile unsigned int duration_cs = 0; duration_cs <= DURATION_TABLE_MAX_CS; duration_cs++) {
+            sink = duration_of_cs_fixed((unsigned short) duration_cs);
+        }
+    }
+
+    const unsigned long long fixed_ns = bench_ns_since(&start_time);
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        for (volatile unsigned int duration_cs = 0; duration_cs <= DURATION_TABLE_MAX_CS; duration_cs++) {
+            sink = DURATION_OF_CS_FLOAT(duration_cs);
+        }
+    }
+
+    const unsigned long long float_ns = bench_ns_since(&start_time);
+    const double             count    = (double) BENCH_ITERATIONS * (DURATION_TABLE_MAX_CS + 1);
+
+    (void) sink;
+
+    printf("%-12s %12.2f %12.2f\n", "duration", (double) fixed_ns / count, (double) float_ns / count);
+}
+
+int main(void) {
+#ifdef LIBREORAMA_FIXED_POINT
+    duration_table_init();
+
+    printf("LIBREORAMA_FIXED_POINT: enabled\n");
+#else
+    printf("LIBREORAMA_FIXED_POINT: disabled\n");
+#endif
+
+    const unsigned long mismatches = verify_intensity();
+
+    printf("mismatches: %lu\n", mismatches);
+    printf("duration table: built from the float conversion, timed only\n");
+    printf("\n");
+    printf("%-12s %12s %12s\n", "conversion", "fixed ns", "float ns");
+
+    bench_intensity();
+    bench_duration();
+
+    return mismatches > 0;
+}
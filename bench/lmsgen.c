@@ -0,0 +1,292 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <getopt.h>
+#include <string.h>
+
+// libreorama_lmsgen writes synthetic LMS sequence files for benchmarking
+// output is fully determined by its options (including the seed), so benchmark inputs are reproducible
+
+// effect lengths are multiples of LMSGEN_STEP_CS, keeping the loaded step_time_ms at 50ms (20 FPS)
+#define LMSGEN_STEP_CS 5
+
+enum lmsgen_effect_t {
+    LMSGEN_INTENSITY,
+    LMSGEN_FADE,
+    LMSGEN_SHIMMER,
+    LMSGEN_TWINKLE,
+    LMSGEN_EFFECT_COUNT,
+};
+
+static void print_usage(void) {
+    printf("Usage: libreorama_lmsgen [options] <output file path>\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("\t-u <unit count> (defaults to 4)\n");
+    printf("\t-c <circuits per unit> (defaults to 16)\n");
+    printf("\t-e <effects per second, per channel> (defaults to 2)\n");
+    printf("\t-m <effect mix as intensity:fade:shimmer:twinkle weights> (defaults to \"4:4:1:1\")\n");
+    printf("\t-d <duration in seconds> (defaults to 180)\n");
+    printf("\t-s <random seed> (defaults to 1)\n");
+}
+
+// xorshift32, used instead of rand() so output is identical across platforms
+static unsigned int lmsgen_next(unsigned int *state) {
+    unsigned int x = *state;
+
+    x ^= x << 13u;
+    x ^= x >> 17u;
+    x ^= x << 5u;
+
+    return *state = x;
+}
+
+static unsigned int lmsgen_range(unsigned int *state,
+                                 unsigned int max) {
+    return lmsgen_next(state) % max;
+}
+
+static int lmsgen_parse_mix(const char *str,
+                            unsigned int *weights) {
+    char *end;
+
+    for (int i = 0; i < LMSGEN_EFFECT_COUNT; i++) {
+        const long weight = strtol(str, &end, 10);
+
+        if (end == str || weight < 0 || weight > 1000) {
+            return 1;
+        }
+
+        weights[i] = (unsigned int) weight;
+
+        if (i < LMSGEN_EFFECT_COUNT - 1) {
+            if (*end != ':') {
+                return 1;
+            }
+
+            str = end + 1;
+        }
+    }
+
+    return *end != '\0';
+}
+
+static enum lmsgen_effect_t lmsgen_pick_effect(unsigned int *state,
+                                               const unsigned int *weights,
+                                               unsigned int weights_total) {
+    unsigned int pick = lmsgen_range(state, weights_total);
+
+    for (int i = 0; i < LMSGEN_EFFECT_COUNT; i++) {
+        if (pick < weights[i]) {
+            return (enum lmsgen_effect_t) i;
+        }
+
+        pick -= weights[i];
+    }
+
+    return LMSGEN_INTENSITY;
+}
+
+static void lmsgen_write_effect(FILE *file,
+                                unsigned int *state,
+                                enum lmsgen_effect_t effect,
+                                unsigned long start_cs,
+                                unsigned long end_cs) {
+    switch (effect) {
+        case LMSGEN_INTENSITY: {
+            // half of all intensity effects are full brightness, which are loaded as ON actions
+            const unsigned int intensity = lmsgen_range(state, 2) ? 100 : lmsgen_range(state, 100);
+
+            fprintf(file, "   <effect type=\"intensity\" startCentisecond=\"%lu\" endCentisecond=\"%lu\" intensity=\"%u\"/>\n", start_cs, end_cs, intensity);
+            break;
+        }
+        case LMSGEN_FADE: {
+            const unsigned int start_intensity = lmsgen_range(state, 101);
+            const unsigned int end_intensity   = lmsgen_range(state, 101);
+
+            fprintf(file, "   <effect type=\"intensity\" startCentisecond=\"%lu\" endCentisecond=\"%lu\" startIntensity=\"%u\" endIntensity=\"%u\"/>\n", start_cs, end_cs, start_intensity, end_intensity);
+            break;
+        }
+        case LMSGEN_SHIMMER:
+            fprintf(file, "   <effect type=\"shimmer\" startCentisecond=\"%lu\" endCentisecond=\"%lu\"/>\n", start_cs, end_cs);
+            break;
+        case LMSGEN_TWINKLE:
+            fprintf(file, "   <effect type=\"twinkle\" startCentisecond=\"%lu\" endCentisecond=\"%lu\"/>\n", start_cs, end_cs);
+            break;
+        default:
+            break;
+    }
+}
+
+int main(int argc,
+         char **argv) {
+    long         unit_count                   = 4;
+    long         circuit_count                = 16;
+    double       effects_per_second           = 2;
+    long         duration_s                   = 180;
+    unsigned int seed                         = 1;
+    unsigned int weights[LMSGEN_EFFECT_COUNT] = {4, 4, 1, 1};
+
+    int c;
+    while ((c = getopt(argc, argv, ":hu:c:e:m:d:s:")) != -1) {
+        switch (c) {
+            case 'h':
+                print_usage();
+                return 0;
+            case 'u':
+                unit_count = strtol(optarg, NULL, 10);
+                break;
+            case 'c':
+                circuit_count = strtol(optarg, NULL, 10);
+                break;
+            case 'e':
+                effects_per_second = strtod(optarg, NULL);
+                break;
+            case 'm':
+                if (lmsgen_parse_mix(optarg, weights)) {
+                    fprintf(stderr, "invalid effect mix: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'd':
+                duration_s = strtol(optarg, NULL, 10);
+                break;
+            case 's':
+                seed = (unsigned int) strtoul(optarg, NULL, 10);
+                break;
+            case ':':
+                fprintf(stderr, "option is missing argument: %c\n", optopt);
+                return 1;
+            case '?':
+            default:
+                fprintf(stderr, "unknown option: %c\n", optopt);
+                return 1;
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc < 1) {
+        print_usage();
+        return 1;
+    }
+
+    // units are written as 1-based unit ids, excluding the broadcast unit id
+    if (unit_count <= 0 || unit_count >= UCHAR_MAX) {
+        fprintf(stderr, "invalid unit count: %ld\n", unit_count);
+        return 1;
+    } else if (circuit_count <= 0 || circuit_count > 512) {
+        fprintf(stderr, "invalid circuit count: %ld\n", circuit_count);
+        return 1;
+    } else if (effects_per_second <= 0 || effects_per_second > 100.0 / LMSGEN_STEP_CS) {
+        fprintf(stderr, "invalid effects per second: %f\n", effects_per_second);
+        return 1;
+    } else if (duration_s <= 0) {
+        fprintf(stderr, "invalid duration: %ld\n", duration_s);
+        return 1;
+    }
+
+    unsigned int weights_total = 0;
+
+    for (int i = 0; i < LMSGEN_EFFECT_COUNT; i++) {
+        weights_total += weights[i];
+    }
+
+    if (weights_total == 0) {
+        fprintf(stderr, "effect mix must contain at least one effect\n");
+        return 1;
+    }
+
+    // xorshift32 has a fixed point at 0
+    if (seed == 0) {
+        seed = 1;
+    }
+
+    FILE *file = fopen(argv[0], "w");
+
+    if (file == NULL) {
+        perror("failed to open output file");
+        return 1;
+    }
+
+    const unsigned long duration_cs = (unsigned long) duration_s * 100;
+
+    // the mean effect length, in steps, that produces the requested effects per second
+    const unsigned long mean_steps = (unsigned long) (100.0 / effects_per_second / LMSGEN_STEP_CS + 0.5);
+
+    unsigned long effect_count = 0;
+
+    fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    fprintf(file, "<sequence musicFilename=\"lmsgen.wav\">\n");
+    fprintf(file, " <channels>\n");
+
+    for (long unit = 1; unit <= unit_count; unit++) {
+        for (long circuit = 1; circuit <= circuit_count; circuit++) {
+            fprintf(file, "  <channel name=\"u%ldc%ld\" unit=\"%ld\" circuit=\"%ld\">\n", unit, circuit, unit, circuit);
+
+            unsigned long start_cs = 0;
+
+            while (start_cs < duration_cs) {
+                // jitter each effect length between 0.5x and 1.5x of the mean
+                unsigned long steps = mean_steps / 2 + lmsgen_range(&seed, (unsigned int) mean_steps + 1);
+
+                if (steps == 0) {
+                    steps = 1;
+                }
+
+                unsigned long end_cs = start_cs + steps * LMSGEN_STEP_CS;
+
+                if (end_cs > duration_cs) {
+                    end_cs = duration_cs;
+                }
+
+                lmsgen_write_effect(file, &seed, lmsgen_pick_effect(&seed, weights, weights_total), start_cs, end_cs);
+
+                effect_count++;
+                start_cs = end_cs;
+            }
+
+            fprintf(file, "  </channel>\n");
+        }
+    }
+
+    fprintf(file, " </channels>\n");
+    fprintf(file, " <tracks>\n");
+    fprintf(file, "  <track totalCentiseconds=\"%lu\"/>\n", duration_cs);
+    fprintf(file, " </tracks>\n");
+    fprintf(file, "</sequence>\n");
+
+    if (fclose(file) != 0) {
+        perror("failed to write output file");
+        return 1;
+    }
+
+    printf("channels: %ld\n", unit_count * circuit_count);
+    printf("effect_count: %lu\n", effect_count);
+
+    return 0;
+}
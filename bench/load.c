@@ -0,0 +1,237 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include <libxml/parser.h>
+#include <libxml/xmlmemory.h>
+
+#include "ctx.h"
+#include "err/lbr.h"
+#include "lorinterface/brightness.h"
+#include "lorinterface/duration.h"
+#include "seqtypes/lormedia.h"
+
+// libreorama_bench_load times #lormedia_sequence_load against the given sequence files
+// inputs may be generated with libreorama_lmsgen for reproducible results
+
+// libxml2 allocations are counted by routing its allocator through these wrappers (see #xmlMemSetup)
+// the loader's own allocations are the channel frame buffers, see channel.h
+static unsigned long xml_alloc_count;
+
+static void *bench_xml_malloc(size_t size) {
+    xml_alloc_count++;
+    return malloc(size);
+}
+
+static void *bench_xml_realloc(void *ptr,
+                               size_t size) {
+    xml_alloc_count++;
+    return realloc(ptr, size);
+}
+
+static char *bench_xml_strdup(const char *str) {
+    xml_alloc_count++;
+    return strdup(str);
+}
+
+static void print_usage(void) {
+    printf("Usage: libreorama_bench_load [options] <sequence file path>...\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("\t-n <iterations per file> (defaults to 10)\n");
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+    // ru_maxrss is reported in bytes on macOS, and kilobytes elsewhere
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static int compare_double(const void *a,
+                          const void *b) {
+    const double x = *(const double *) a;
+    const double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+static int bench_load_file(struct libreorama_ctx *ctx,
+                           const char *sequence_file,
+                           long iterations,
+                           double *load_ms) {
+    struct stat file_stat;
+
+    if (stat(sequence_file, &file_stat) != 0) {
+        return LBR_EERRNO;
+    }
+
+    struct sequence_t sequence;
+    unsigned long     xml_allocs = 0;
+
+    const long baseline_rss_kb = peak_rss_kb();
+
+    for (long i = 0; i < iterations; i++) {
+        sequence = (struct sequence_t) {
+                .step_time_ms = 50,
+        };
+
+        char *audio_file_hint = NULL;
+
+        struct timespec start_time;
+        struct timespec stop_time;
+
+        const unsigned long start_alloc_count = xml_alloc_count;
+
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+        const int err = lormedia_sequence_load(ctx, sequence_file, &audio_file_hint, &sequence);
+
+        clock_gettime(CLOCK_MONOTONIC, &stop_time);
+
+        xml_allocs = xml_alloc_count - start_alloc_count;
+
+        free(audio_file_hint);
+
+        // release the loaded channels so each iteration starts from an empty context
+        libreorama_ctx_free(ctx);
+        libreorama_ctx_init(ctx);
+
+        if (err) {
+            return err;
+        }
+
+        load_ms[i] = (double) (stop_time.tv_sec - start_time.tv_sec) * 1000.0 + (double) (stop_time.tv_nsec - start_time.tv_nsec) / 1000000.0;
+    }
+
+    qsort(load_ms, (size_t) iterations, sizeof(double), compare_double);
+
+    double load_ms_total = 0;
+
+    for (long i = 0; i < iterations; i++) {
+        load_ms_total += load_ms[i];
+    }
+
+    const double load_ms_mean = load_ms_total / (double) iterations;
+    const double file_mb      = (double) file_stat.st_size / (1024.0 * 1024.0);
+
+    printf("sequence_file: %s (%.2f MB)\n", sequence_file, file_mb);
+    printf("frame_count: %u (%dms step time)\n", sequence.frame_count, sequence.step_time_ms);
+    printf("effect_count: %lu\n", sequence.effect_count);
+    printf("load ms: %.3f min, %.3f median, %.3f mean (%ld iterations)\n", load_ms[0], load_ms[iterations / 2], load_ms_mean, iterations);
+    printf("throughput: %.0f effects/s, %.2f MB/s\n", (double) sequence.effect_count / (load_ms_mean / 1000.0), file_mb / (load_ms_mean / 1000.0));
+    printf("libxml2 allocations per load: %lu\n", xml_allocs);
+    printf("peak RSS: %ld KB (%ld KB prior to loading)\n", peak_rss_kb(), baseline_rss_kb);
+    printf("\n");
+
+    return 0;
+}
+
+int main(int argc,
+         char **argv) {
+    long iterations = 10;
+
+    int c;
+    while ((c = getopt(argc, argv, ":hn:")) != -1) {
+        switch (c) {
+            case 'h':
+                print_usage();
+                return 0;
+            case 'n':
+                iterations = strtol(optarg, NULL, 10);
+
+                if (iterations <= 0) {
+                    fprintf(stderr, "invalid iteration count: %ld\n", iterations);
+                    return 1;
+                }
+                break;
+            case ':':
+                fprintf(stderr, "option is missing argument: %c\n", optopt);
+                return 1;
+            case '?':
+            default:
+                fprintf(stderr, "unknown option: %c\n", optopt);
+                return 1;
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc < 1) {
+        print_usage();
+        return 1;
+    }
+
+    // the allocator must be replaced before libxml2 is initialized
+    xmlMemSetup(free, bench_xml_malloc, bench_xml_realloc, bench_xml_strdup);
+    brightness_tables_init();
+#ifdef LIBREORAMA_FIXED_POINT
+    duration_table_init();
+#endif
+    xmlInitParser();
+
+    struct libreorama_ctx *ctx     = malloc(sizeof(struct libreorama_ctx));
+    double                *load_ms = malloc(sizeof(double) * (size_t) iterations);
+    int                   ret      = 0;
+
+    if (ctx == NULL || load_ms == NULL) {
+        lbr_perror(LBR_EERRNO, "failed to allocate benchmark");
+        ret = 1;
+        goto bench_free;
+    }
+
+    libreorama_ctx_init(ctx);
+
+    for (int i = 0; i < argc; i++) {
+        int err;
+        if ((err = bench_load_file(ctx, argv[i], iterations, load_ms))) {
+            lbr_perror(err, "failed to load sequence");
+            ret = 1;
+            break;
+        }
+    }
+
+    bench_free:
+    free(load_ms);
+    free(ctx);
+
+    xmlCleanupParser();
+
+    return ret;
+}
@@ -0,0 +1,452 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+
+#include "ctx.h"
+#include "err/lbr.h"
+#include "lorinterface/brightness.h"
+#include "lorinterface/duration.h"
+#include "lorinterface/encode.h"
+#include "lorinterface/minify.h"
+#include "lorinterface/state.h"
+
+// libreorama_bench_minify drives #minify_frame (and by extension #encode_frame) with scripted channel patterns
+// each pattern reports the time spent, bytes encoded and commands encoded per frame
+
+#define BENCH_STEP_TIME_MS 50
+
+struct bench_pattern_t {
+    const char *name;
+
+    int (*fill)(struct libreorama_ctx *ctx,
+                frame_palette_index_t *frames,
+                size_t channel_count,
+                size_t circuit_count,
+                frame_index_t frame_count,
+                unsigned int *seed);
+};
+
+static void print_usage(void) {
+    printf("Usage: libreorama_bench_minify [options]\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("\t-u <unit count> (defaults to 8)\n");
+    printf("\t-c <circuits per unit> (defaults to 16)\n");
+    printf("\t-f <frame count> (defaults to 12000)\n");
+    printf("\t-n <iterations per pattern> (defaults to 5)\n");
+}
+
+// xorshift32, patterns are identical across runs and platforms
+static unsigned int bench_random(unsigned int *seed) {
+    unsigned int x = *seed;
+
+    x ^= x << 13u;
+    x ^= x >> 17u;
+    x ^= x << 5u;
+
+    return *seed = x;
+}
+
+static struct frame_t bench_frame_on(void) {
+    return (struct frame_t) {
+            .action = LOR_ACTION_CHANNEL_ON,
+    };
+}
+
+static struct frame_t bench_frame_brightness(unsigned char brightness) {
+    return (struct frame_t) {
+            .action = LOR_ACTION_CHANNEL_SET_BRIGHTNESS,
+            .set_brightness = brightness,
+    };
+}
+
+// patterns are filled as dense palette indexes (see frame.h), channel-major
+// each channel's frames are then encoded into its timeline
+static int bench_set(struct libreorama_ctx *ctx,
+                     frame_palette_index_t *frames,
+                     frame_index_t frame_count,
+                     size_t channel,
+                     size_t frame_index,
+                     struct frame_t frame) {
+    return frame_palette_intern(ctx, frame, &frames[channel * frame_count + frame_index]);
+}
+
+// every channel flashes on and off each frame, the best case for channel masks
+static int bench_fill_all_on(struct libreorama_ctx *ctx,
+                             frame_palette_index_t *frames,
+                             size_t channel_count,
+                             size_t circuit_count,
+                             frame_index_t frame_count,
+                             unsigned int *seed) {
+    (void) seed;
+    (void) circuit_count;
+
+    int err;
+
+    for (frame_index_t frame_index = 0; frame_index < frame_count; frame_index++) {
+        for (size_t i = 0; i < channel_count; i++) {
+            if ((err = bench_set(ctx, frames, frame_count, i, frame_index, frame_index % 2 == 0 ? bench_frame_on() : bench_frame_brightness(0)))) {
+                return err;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// a single lit circuit moves along each unit, one circuit per frame
+static int bench_fill_chase(struct libreorama_ctx *ctx,
+                            frame_palette_index_t *frames,
+                            size_t channel_count,
+                            size_t circuit_count,
+                            frame_index_t frame_count,
+                            unsigned int *seed) {
+    (void) seed;
+
+    int err;
+
+    for (frame_index_t frame_index = 0; frame_index < frame_count; frame_index++) {
+        for (size_t i = 0; i < channel_count; i++) {
+            const size_t circuit = i % circuit_count;
+
+            if (circuit == frame_index % circuit_count) {
+                if ((err = bench_set(ctx, frames, frame_count, i, frame_index, bench_frame_on()))) {
+                    return err;
+                }
+            } else if (circuit == (frame_index + circuit_count - 1) % circuit_count) {
+                if ((err = bench_set(ctx, frames, frame_count, i, frame_index, bench_frame_brightness(0)))) {
+                    return err;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+// roughly a quarter of all channels change each frame, to twinkle or a random brightness
+static int bench_fill_twinkle(struct libreorama_ctx *ctx,
+                              frame_palette_index_t *frames,
+                              size_t channel_count,
+                              size_t circuit_count,
+                              frame_index_t frame_count,
+                              unsigned int *seed) {
+    (void) circuit_count;
+
+    int err;
+
+    for (frame_index_t frame_index = 0; frame_index < frame_count; frame_index++) {
+        for (size_t i = 0; i < channel_count; i++) {
+            const unsigned int r = bench_random(seed);
+
+            if (r % 4 != 0) {
+                continue;
+            }
+
+            const struct frame_t frame = r & 0x100u ? (struct frame_t) {
+                    .action = LOR_ACTION_CHANNEL_TWINKLE,
+            } : bench_frame_brightness((unsigned char) (r >> 16u));
+
+            if ((err = bench_set(ctx, frames, frame_count, i, frame_index, frame))) {
+                return err;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// each unit ramps up and down over 1 second, offset by unit so units never share a fade
+static int bench_fill_fade_ramps(struct libreorama_ctx *ctx,
+                                 frame_palette_index_t *frames,
+                                 size_t channel_count,
+                                 size_t circuit_count,
+                                 frame_index_t frame_count,
+                                 unsigned int *seed) {
+    (void) seed;
+
+    int err;
+
+    const frame_index_t ramp_frames = 1000 / BENCH_STEP_TIME_MS;
+
+    for (size_t i = 0; i < channel_count; i++) {
+        const size_t unit_offset = i / circuit_count;
+
+        for (size_t frame_index = unit_offset % ramp_frames; frame_index < frame_count; frame_index += ramp_frames) {
+            const bool up = (frame_index / ramp_frames) % 2 == 0;
+
+            const struct frame_t frame = (struct frame_t) {
+                    .action = LOR_ACTION_CHANNEL_FADE,
+                    .fade = {
+                            .from = up ? 0 : 255,
+                            .to = up ? 255 : 0,
+                            .duration_cs = ramp_frames * BENCH_STEP_TIME_MS / 10,
+                    },
+            };
+
+            if ((err = bench_set(ctx, frames, frame_count, i, frame_index, frame))) {
+                return err;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// channels rarely blink on for a single frame, leaving most frames empty
+static int bench_fill_sparse(struct libreorama_ctx *ctx,
+                             frame_palette_index_t *frames,
+                             size_t channel_count,
+                             size_t circuit_count,
+                             frame_index_t frame_count,
+                             unsigned int *seed) {
+    (void) circuit_count;
+
+    int err;
+
+    for (frame_index_t frame_index = 0; frame_index + 1 < frame_count; frame_index++) {
+        for (size_t i = 0; i < channel_count; i++) {
+            if (bench_random(seed) % 200 == 0) {
+                if ((err = bench_set(ctx, frames, frame_count, i, frame_index, bench_frame_on()))) {
+                    return err;
+                }
+
+                if ((err = bench_set(ctx, frames, frame_count, i, frame_index + 1, bench_frame_brightness(0)))) {
+                    return err;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static const struct bench_pattern_t BENCH_PATTERNS[] = {
+        {"all_on",     bench_fill_all_on},
+        {"chase",      bench_fill_chase},
+        {"twinkle",    bench_fill_twinkle},
+        {"fade_ramps", bench_fill_fade_ramps},
+        {"sparse",     bench_fill_sparse},
+};
+
+static int bench_pattern(struct libreorama_ctx *ctx,
+                         const struct bench_pattern_t *pattern,
+                         long unit_count,
+                         long circuit_count,
+                         frame_index_t frame_count,
+                         long iterations) {
+    int err;
+
+    if ((err = channel_buffer_reserve(ctx, (size_t) (unit_count * circuit_count)))) {
+        return err;
+    }
+
+    // a timeline is never larger than a frame per step
+    if ((err = frame_buffer_reserve(ctx, (size_t) (unit_count * circuit_count) * frame_count))) {
+        return err;
+    }
+
+    frame_palette_index_t *dense_frames = calloc((size_t) (unit_count * circuit_count) * frame_count, sizeof(frame_palette_index_t));
+
+    if (dense_frames == NULL) {
+        return LBR_EERRNO;
+    }
+
+    unsigned int seed = 1;
+
+    if ((err = pattern->fill(ctx, dense_frames, (size_t) (unit_count * circuit_count), (size_t) circuit_count, frame_count, &seed))) {
+        goto bench_pattern_free;
+    }
+
+    for (long unit = 1; unit <= unit_count; unit++) {
+        for (long circuit = 0; circuit < circuit_count; circuit++) {
+            struct channel_t *channel;
+
+            if ((err = channel_buffer_request(ctx, (lor_unit_t) unit, (lor_channel_t) circuit, &channel))) {
+                goto bench_pattern_free;
+            }
+
+            if ((err = timeline_store(ctx, &channel->timeline, &dense_frames[(ctx->channel_buffer_index - 1) * frame_count], frame_count))) {
+                goto bench_pattern_free;
+            }
+        }
+    }
+
+    bench_pattern_free:
+    free(dense_frames);
+
+    if (err) {
+        return err;
+    }
+
+    const struct sequence_t sequence = {
+            .step_time_ms = BENCH_STEP_TIME_MS,
+            .frame_count = frame_count,
+    };
+
+    // commands are counted in an untimed pass, since each iteration encodes identical output
+    struct encode_stats_t stats;
+
+    memset(&stats, 0, sizeof(stats));
+
+    ctx->encode_stats = &stats;
+
+    for (frame_index_t frame_index = 0; frame_index < frame_count; frame_index++) {
+        if ((err = minify_frame(ctx, sequence, frame_index))) {
+            return err;
+        }
+
+        encode_buffer_reset(ctx);
+    }
+
+    ctx->encode_stats = NULL;
+
+    unsigned long long total_ns    = 0;
+    unsigned long long total_bytes = 0;
+
+    for (long i = 0; i < iterations; i++) {
+        // each iteration starts with all channels off, matching playback
+        channel_output_state_reset(ctx);
+
+        for (frame_index_t frame_index = 0; frame_index < frame_count; frame_index++) {
+            struct timespec start_time;
+            struct timespec stop_time;
+
+            clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+            if ((err = minify_frame(ctx, sequence, frame_index))) {
+                return err;
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &stop_time);
+
+            total_ns += (unsigned long long) (stop_time.tv_sec - start_time.tv_sec) * 1000000000ull + (unsigned long long) (stop_time.tv_nsec - start_time.tv_nsec);
+            total_bytes += ctx->encode_buffer_index;
+
+            encode_buffer_reset(ctx);
+        }
+    }
+
+    unsigned long total_commands = 0;
+
+    for (int command = 0; command < ENCODE_STATS_COMMAND_COUNT; command++) {
+        total_commands += stats.command_count[command];
+    }
+
+    const double frames = (double) frame_count * (double) iterations;
+
+    printf("%-12s %12.1f %12.2f %14.2f\n", pattern->name, (double) total_ns / frames, (double) total_bytes / frames, (double) total_commands / frame_count);
+
+    return 0;
+}
+
+int main(int argc,
+         char **argv) {
+    long unit_count    = 8;
+    long circuit_count = 16;
+    long frame_count   = 12000;
+    long iterations    = 5;
+
+    int c;
+    while ((c = getopt(argc, argv, ":hu:c:f:n:")) != -1) {
+        switch (c) {
+            case 'h':
+                print_usage();
+                return 0;
+            case 'u':
+                unit_count = strtol(optarg, NULL, 10);
+                break;
+            case 'c':
+                circuit_count = strtol(optarg, NULL, 10);
+                break;
+            case 'f':
+                frame_count = strtol(optarg, NULL, 10);
+                break;
+            case 'n':
+                iterations = strtol(optarg, NULL, 10);
+                break;
+            case ':':
+                fprintf(stderr, "option is missing argument: %c\n", optopt);
+                return 1;
+            case '?':
+            default:
+                fprintf(stderr, "unknown option: %c\n", optopt);
+                return 1;
+        }
+    }
+
+    if (unit_count <= 0 || circuit_count <= 0 || unit_count >= LOR_UNIT_ID_BROADCAST || circuit_count > (lor_channel_t) -1) {
+        fprintf(stderr, "unit & circuit counts must be positive, with fewer than %d units\n", LOR_UNIT_ID_BROADCAST);
+        return 1;
+    } else if (frame_count <= 1 || frame_count > (frame_index_t) -1) {
+        fprintf(stderr, "invalid frame count: %ld\n", frame_count);
+        return 1;
+    } else if (iterations <= 0) {
+        fprintf(stderr, "invalid iteration count: %ld\n", iterations);
+        return 1;
+    }
+
+    struct libreorama_ctx *ctx = malloc(sizeof(struct libreorama_ctx));
+
+    if (ctx == NULL) {
+        lbr_perror(LBR_EERRNO, "failed to allocate context");
+        return 1;
+    }
+
+    libreorama_ctx_init(ctx);
+
+    brightness_tables_init();
+#ifdef LIBREORAMA_FIXED_POINT
+    duration_table_init();
+#endif
+
+    printf("channels: %ld (%ld units, %ld circuits per unit)\n", unit_count * circuit_count, unit_count, circuit_count);
+    printf("frames: %ld (%ld iterations)\n", frame_count, iterations);
+    printf("\n");
+    printf("%-12s %12s %12s %14s\n", "pattern", "ns/frame", "bytes/frame", "commands/frame");
+
+    int ret = 0;
+
+    for (size_t i = 0; i < sizeof(BENCH_PATTERNS) / sizeof(BENCH_PATTERNS[0]); i++) {
+        const int err = bench_pattern(ctx, &BENCH_PATTERNS[i], unit_count, circuit_count, (frame_index_t) frame_count, iterations);
+
+        // release the pattern's channels so each pattern starts from an empty context
+        libreorama_ctx_free(ctx);
+        libreorama_ctx_init(ctx);
+
+        if (err) {
+            lbr_perror(err, "failed to run pattern");
+            ret = 1;
+            break;
+        }
+    }
+
+    free(ctx);
+
+    return ret;
+}
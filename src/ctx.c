@@ -0,0 +1,49 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "ctx.h"
+
+#include <stdlib.h>
+
+#include "player/window.h"
+
+static const struct libreorama_ctx LIBREORAMA_CTX_EMPTY;
+
+void libreorama_ctx_init(struct libreorama_ctx *ctx) {
+    *ctx = LIBREORAMA_CTX_EMPTY;
+}
+
+void libreorama_ctx_free(struct libreorama_ctx *ctx) {
+    // release any sequence data still held by the context
+    // OpenAL objects are owned by the player, see #player_free
+    free(ctx->resident_sequence_file);
+
+    // release any dangling pointers and avoid double free
+    ctx->resident_sequence_file = NULL;
+
+    // the window's worker reads the channel & frame buffers, it is stopped before they are released
+    window_free(ctx);
+    channel_buffer_free(ctx);
+    keyframe_index_free(ctx);
+    frame_buffer_free(ctx);
+}
@@ -0,0 +1,139 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LIBREORAMA_CTX_H
+#define LIBREORAMA_CTX_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "err/al.h"
+#include "file.h"
+#include "lorinterface/channel.h"
+#include "lorinterface/encode.h"
+#include "lorinterface/keyframe.h"
+#include "lorinterface/minify.h"
+#include "lorinterface/state.h"
+#include "player/sequence.h"
+
+struct compositor_t;
+struct frame_stats_t;
+struct metrics_t;
+struct player_carry_t;
+struct window_t;
+
+// libreorama_ctx owns all state used by the loading & playback path
+// contexts are independent of each other, allowing multiple players per process
+//  or sequences to be loaded on worker threads (one context per thread)
+struct libreorama_ctx {
+    // see channel.h
+    // every buffer indexed by channel is a slice of channel_block, holding channel_buffer_capacity entries
+    void                  *channel_block;
+    size_t                channel_block_length;
+    size_t                channel_buffer_capacity;
+    struct channel_t      *channel_buffer;
+    size_t                channel_buffer_index;
+    struct channel_unit_t channel_units[UCHAR_MAX + 1];
+
+    // see state.h
+    struct channel_output_state_t *output_state;
+
+    // see minify.h
+    struct frame_t          *upcoming_frames_buffer;
+    frame_palette_index_t   *upcoming_palette_buffer;
+    unsigned char           minify_tolerance;
+    struct minify_command_t *command_buffer;
+    size_t                  command_buffer_index;
+    bool                    broadcast_dedup;
+    bool                    channel_banks;
+    bool                    *broadcast_dedup_flags;
+    size_t                  *broadcast_dedup_corrections;
+
+    // see brightness.h, each unit's enum brightness_curve_t
+    unsigned char unit_brightness_curve[UCHAR_MAX + 1];
+
+    // see encode.h
+    unsigned char         *encode_buffer;
+    size_t                encode_buffer_capacity;
+    size_t                encode_buffer_index;
+    struct encode_stats_t *encode_stats;
+
+    // see frame.h
+    struct frame_block_t  *frame_blocks;
+    frame_palette_index_t *frame_scratch;
+    frame_index_t         frame_scratch_count;
+    struct frame_t        *frame_palette;
+    size_t                frame_palette_count;
+    size_t                frame_palette_capacity;
+    frame_palette_index_t *frame_palette_slots;
+    size_t                frame_palette_slot_count;
+
+    // see keyframe.h
+    struct keyframe_state_t *keyframe_index;
+    size_t                  keyframe_count;
+    struct keyframe_state_t *restore_state_buffer;
+    struct frame_t          *restore_frame_buffer;
+
+    // see file.h
+    char file_line_buffer[FILE_LINE_BUFFER_MAX_LENGTH];
+
+    // see player.h
+    ALuint            al_source;
+    ALuint            current_al_buffer;
+    bool              has_al_source;
+    bool              has_al_buffer;
+    bool              stop_requested;
+    char              *resident_sequence_file;
+    struct sequence_t resident_sequence;
+
+    // see player.h, when output_persist is set the output is not reset between sequences
+    // the last sent state of each channel is instead carried into the next sequence
+    bool                  output_persist;
+    struct player_carry_t *output_carry;
+    size_t                output_carry_count;
+
+    // see realtime.h, buffers are prefaulted before playback when set
+    bool realtime_prefault;
+
+    // optional, see window.h
+    // when window_ms is set, sequences are decoded window_ms ahead of playback rather than loaded up front
+    unsigned long   window_ms;
+    struct window_t *window;
+
+    // optional, see framestats.h
+    struct frame_stats_t *frame_stats;
+
+    // optional, see metrics.h
+    struct metrics_t *metrics;
+
+    // optional, see compositor.h
+    // when set, the resident sequence is played as the top layer of the compositor
+    struct compositor_t *compositor;
+};
+
+void libreorama_ctx_init(struct libreorama_ctx *ctx);
+
+void libreorama_ctx_free(struct libreorama_ctx *ctx);
+
+#endif //LIBREORAMA_CTX_H
@@ -0,0 +1,476 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "daemon.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "err/lbr.h"
+#include "lorinterface/encode.h"
+#include "player/framestats.h"
+#include "metrics.h"
+
+#define DAEMON_PATH_MAX_LENGTH    256
+#define DAEMON_COMMAND_MAX_LENGTH 512
+#define DAEMON_METRICS_MAX_LENGTH 4096
+
+// clients are closed once connected for DAEMON_CLIENT_TIMEOUT_MS without sending a complete command
+// this ensures a silent client cannot hold a slot indefinitely
+#define DAEMON_CLIENT_MAX_COUNT  8
+#define DAEMON_CLIENT_TIMEOUT_MS 1000
+
+// queued sequence file paths, stored in a fixed ring buffer to avoid dynamic allocations
+static char   queue[DAEMON_QUEUE_MAX_LENGTH][DAEMON_PATH_MAX_LENGTH];
+static size_t queue_head;
+static size_t queue_length;
+
+static char current_sequence_file[DAEMON_PATH_MAX_LENGTH];
+static bool is_playing;
+static long played_count;
+
+static int listen_fd = -1;
+
+// control connections are serviced together, each holding a single partially read command
+// commands are read without blocking so that playback is never stalled by a slow client
+struct daemon_client_t {
+    int      fd;
+    uint64_t connected_ns;
+    char     command_buffer[DAEMON_COMMAND_MAX_LENGTH];
+    size_t   command_buffer_index;
+};
+
+static struct daemon_client_t clients[DAEMON_CLIENT_MAX_COUNT];
+
+static player_frame_interrupt_t daemon_frame_interrupt;
+
+// set by SIGINT & SIGTERM, the daemon stops playback and closes its socket before returning
+static volatile sig_atomic_t exit_requested;
+
+static bool daemon_path_fits(const char *sequence_file) {
+    return strlen(sequence_file) + 1 <= DAEMON_PATH_MAX_LENGTH;
+}
+
+static int daemon_queue_push(const char *sequence_file) {
+    if (queue_length >= DAEMON_QUEUE_MAX_LENGTH || !daemon_path_fits(sequence_file)) {
+        return 1;
+    }
+
+    const size_t tail = (queue_head + queue_length) % DAEMON_QUEUE_MAX_LENGTH;
+
+    strcpy(queue[tail], sequence_file);
+    queue_length++;
+
+    return 0;
+}
+
+static const char *daemon_queue_pop() {
+    if (queue_length == 0) {
+        return NULL;
+    }
+
+    const char *sequence_file = queue[queue_head];
+
+    queue_head = (queue_head + 1) % DAEMON_QUEUE_MAX_LENGTH;
+    queue_length--;
+
+    return sequence_file;
+}
+
+static void daemon_queue_clear() {
+    queue_head   = 0;
+    queue_length = 0;
+}
+
+static void daemon_client_close(struct daemon_client_t *client) {
+    close(client->fd);
+
+    client->fd                   = -1;
+    client->command_buffer_index = 0;
+}
+
+static void daemon_client_reply(const struct daemon_client_t *client,
+                                const char *reply) {
+    // replies are best effort, a client which has already disconnected is ignored
+    const ssize_t written = write(client->fd, reply, strlen(reply));
+
+    (void) written;
+}
+
+static void daemon_handle_command(struct libreorama_ctx *ctx,
+                                  const struct daemon_client_t *client,
+                                  char *command) {
+    char *argument = strchr(command, ' ');
+
+    if (argument != NULL) {
+        *argument++ = 0;
+    }
+
+    if (strcmp(command, "play") == 0 && argument != NULL) {
+        // the path is checked first, so a rejected play leaves the queue and current sequence untouched
+        if (!daemon_path_fits(argument)) {
+            daemon_client_reply(client, "error: queue is full or path is too long\n");
+            return;
+        }
+
+        // replace the queue and interrupt the current sequence, if any
+        daemon_queue_clear();
+        daemon_queue_push(argument);
+
+        if (is_playing) {
+            player_stop(ctx);
+        }
+    } else if (strcmp(command, "queue") == 0 && argument != NULL) {
+        if (daemon_queue_push(argument)) {
+            daemon_client_reply(client, "error: queue is full or path is too long\n");
+            return;
+        }
+    } else if (strcmp(command, "skip") == 0) {
+        if (is_playing) {
+            player_stop(ctx);
+        }
+    } else if (strcmp(command, "stop") == 0) {
+        daemon_queue_clear();
+
+        if (is_playing) {
+            player_stop(ctx);
+        }
+    } else if (strcmp(command, "stats") == 0) {
+        char reply[DAEMON_PATH_MAX_LENGTH + 128];
+
+        snprintf(reply, sizeof(reply), "state: %s\ncurrent: %s\nqueued: %zu\nplayed: %ld\n",
+                 is_playing ? "playing" : "idle",
+                 is_playing ? current_sequence_file : "",
+                 queue_length,
+                 played_count);
+
+        daemon_client_reply(client, reply);
+        return;
+    } else if (strcmp(command, "metrics") == 0) {
+        if (ctx->metrics == NULL) {
+            daemon_client_reply(client, "error: metrics are not enabled\n");
+            return;
+        }
+
+        char reply[DAEMON_METRICS_MAX_LENGTH];
+
+        metrics_format(ctx->metrics, reply, sizeof(reply));
+
+        daemon_client_reply(client, reply);
+        return;
+    } else {
+        daemon_client_reply(client, "error: unknown command\n");
+        return;
+    }
+
+    daemon_client_reply(client, "ok\n");
+}
+
+// reads any pending data from the client, handling its command once complete
+static void daemon_client_read(struct libreorama_ctx *ctx,
+                               struct daemon_client_t *client,
+                               uint64_t now_ns) {
+    const ssize_t read_len = read(client->fd, &client->command_buffer[client->command_buffer_index], sizeof(client->command_buffer) - client->command_buffer_index - 1);
+
+    if (read_len == 0 || (read_len < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        // client disconnected or failed before sending a full command
+        daemon_client_close(client);
+        return;
+    } else if (read_len < 0) {
+        // drop clients which have not sent a full command in time
+        if (now_ns - client->connected_ns >= (uint64_t) DAEMON_CLIENT_TIMEOUT_MS * 1000000u) {
+            daemon_client_close(client);
+        }
+
+        return;
+    }
+
+    client->command_buffer_index += (size_t) read_len;
+    client->command_buffer[client->command_buffer_index] = 0;
+
+    char *newline = strchr(client->command_buffer, '\n');
+
+    if (newline == NULL) {
+        // drop clients which exceed the command buffer without a newline
+        if (client->command_buffer_index >= sizeof(client->command_buffer) - 1) {
+            daemon_client_close(client);
+        }
+
+        return;
+    }
+
+    *newline = 0;
+
+    // tolerate CRLF terminated commands
+    if (newline > client->command_buffer && newline[-1] == '\r') {
+        newline[-1] = 0;
+    }
+
+    daemon_handle_command(ctx, client, client->command_buffer);
+    daemon_client_close(client);
+}
+
+static int daemon_poll(struct libreorama_ctx *ctx) {
+    const uint64_t now_ns = frame_stats_now_ns();
+
+    // accept pending connections into any free slots, others wait in the listen backlog
+    for (size_t i = 0; i < DAEMON_CLIENT_MAX_COUNT; i++) {
+        struct daemon_client_t *client = &clients[i];
+
+        if (client->fd != -1) {
+            continue;
+        }
+
+        if ((client->fd = accept(listen_fd, NULL, NULL)) == -1) {
+            // the listening socket is non-blocking, no pending connection is not an error
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                break;
+            }
+
+            return LBR_EERRNO;
+        }
+
+        fcntl(client->fd, F_SETFL, O_NONBLOCK);
+
+        client->connected_ns         = now_ns;
+        client->command_buffer_index = 0;
+    }
+
+    for (size_t i = 0; i < DAEMON_CLIENT_MAX_COUNT; i++) {
+        if (clients[i].fd != -1) {
+            daemon_client_read(ctx, &clients[i], now_ns);
+        }
+    }
+
+    return 0;
+}
+
+// blocks until the listen socket or any client is readable, or timeout_ms elapses
+static int daemon_wait(int timeout_ms) {
+    struct pollfd poll_fds[DAEMON_CLIENT_MAX_COUNT + 1];
+    nfds_t        poll_fd_count = 0;
+    bool          has_free_slot = false;
+
+    for (size_t i = 0; i < DAEMON_CLIENT_MAX_COUNT; i++) {
+        if (clients[i].fd == -1) {
+            has_free_slot = true;
+            continue;
+        }
+
+        poll_fds[poll_fd_count++] = (struct pollfd) {
+                .fd = clients[i].fd,
+                .events = POLLIN,
+        };
+    }
+
+    // connections are left in the listen backlog until a slot is free
+    if (has_free_slot) {
+        poll_fds[poll_fd_count++] = (struct pollfd) {
+                .fd = listen_fd,
+                .events = POLLIN,
+        };
+    }
+
+    if (poll(poll_fds, poll_fd_count, timeout_ms) == -1 && errno != EINTR) {
+        return LBR_EERRNO;
+    }
+
+    return 0;
+}
+
+static int daemon_handle_frame_interrupt(struct libreorama_ctx *ctx,
+                                         unsigned short step_time_ms) {
+    int err;
+    if ((err = daemon_frame_interrupt(ctx, step_time_ms))) {
+        return err;
+    }
+
+    // stop playback (and any queued sequences) once exit has been requested
+    if (exit_requested) {
+        daemon_queue_clear();
+        player_stop(ctx);
+        return 0;
+    }
+
+    // service the control socket once per frame, after the frame has been written
+    return daemon_poll(ctx);
+}
+
+static void daemon_handle_exit_signal(int signum) {
+    exit_requested = 1;
+
+    (void) signum;
+}
+
+static int daemon_listen(const char *socket_path) {
+    struct sockaddr_un addr;
+
+    if (strlen(socket_path) + 1 > sizeof(addr.sun_path)) {
+        return LBR_FILE_EPATHTOOLONG;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+        return LBR_EERRNO;
+    }
+
+    // remove any stale socket left behind by a previous daemon
+    unlink(socket_path);
+
+    if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 || listen(listen_fd, 4) == -1) {
+        return LBR_EERRNO;
+    }
+
+    fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+
+    return 0;
+}
+
+// closes every connection and removes the socket path, so a later daemon does not find a stale socket
+static void daemon_close(const char *socket_path) {
+    for (size_t i = 0; i < DAEMON_CLIENT_MAX_COUNT; i++) {
+        if (clients[i].fd != -1) {
+            daemon_client_close(&clients[i]);
+        }
+    }
+
+    if (listen_fd != -1) {
+        close(listen_fd);
+        unlink(socket_path);
+
+        listen_fd = -1;
+    }
+}
+
+static int daemon_loop(struct libreorama_ctx *ctx,
+                       unsigned short time_correction_ms) {
+    int err;
+
+    // the output state is unknown until the first reset
+    if ((err = player_reset(ctx, daemon_frame_interrupt))) {
+        return err;
+    }
+
+    uint64_t last_heartbeat_ns = frame_stats_now_ns();
+
+    while (!exit_requested) {
+        const char *next_sequence_file = daemon_queue_pop();
+
+        if (next_sequence_file == NULL) {
+            // heartbeats continue while idle, otherwise controllers leave network control between sequences
+            const uint64_t now_ns       = frame_stats_now_ns();
+            const uint64_t heartbeat_ns = (uint64_t) ENCODE_HEARTBEAT_INTERVAL_MS * 1000000u;
+            const uint64_t elapsed_ns   = now_ns - last_heartbeat_ns;
+
+            if (elapsed_ns >= heartbeat_ns) {
+                if ((err = player_idle(ctx, daemon_frame_interrupt))) {
+                    lbr_perror(err, "failed to write idle heartbeat");
+                }
+
+                last_heartbeat_ns = now_ns;
+                continue;
+            }
+
+            // block until a control client connects or sends data, or the next heartbeat is due
+            if ((err = daemon_wait((int) ((heartbeat_ns - elapsed_ns + 999999u) / 1000000u)))) {
+                return err;
+            }
+
+            if ((err = daemon_poll(ctx))) {
+                return err;
+            }
+
+            continue;
+        }
+
+        // copy the path out of the queue since the slot may be reused while playing
+        strncpy(current_sequence_file, next_sequence_file, sizeof(current_sequence_file) - 1);
+
+        is_playing = true;
+        err        = player_start(ctx, daemon_handle_frame_interrupt, time_correction_ms, current_sequence_file);
+        is_playing = false;
+
+        played_count++;
+
+        // a sequence which fails to load or play should not terminate the daemon
+        // the error is reported and the next queued sequence is played
+        if (err) {
+            lbr_perror(err, "failed to play sequence");
+        }
+
+        // queued sequences follow on from each other's output state without a reset
+        // the output is only reset once the daemon is idle, or a sequence has failed part way through
+        if (err || queue_length == 0) {
+            if ((err = player_reset(ctx, daemon_frame_interrupt))) {
+                lbr_perror(err, "failed to reset output");
+            }
+        }
+
+        last_heartbeat_ns = frame_stats_now_ns();
+    }
+
+    return 0;
+}
+
+int daemon_run(struct libreorama_ctx *ctx,
+               const char *socket_path,
+               player_frame_interrupt_t frame_interrupt,
+               unsigned short time_correction_ms) {
+    // the serial port, OpenAL context and last played sequence remain warm between sequences
+    // control clients may disconnect before a reply is written, this must not terminate the daemon
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, daemon_handle_exit_signal);
+    signal(SIGTERM, daemon_handle_exit_signal);
+
+    daemon_frame_interrupt = frame_interrupt;
+
+    for (size_t i = 0; i < DAEMON_CLIENT_MAX_COUNT; i++) {
+        clients[i].fd = -1;
+    }
+
+    // the output is carried between queued sequences rather than reset (see player.h)
+    ctx->output_persist = true;
+
+    int err;
+    if ((err = daemon_listen(socket_path)) == 0) {
+        printf("listening for commands on %s\n", socket_path);
+
+        err = daemon_loop(ctx, time_correction_ms);
+    }
+
+    daemon_close(socket_path);
+
+    return err;
+}
@@ -57,7 +57,11 @@ char *lbr_error_string(int err) {
         case LBR_SEQUENCE_EWRITEINDEX:
             return "LBR_SEQUENCE_EWRITEINDEX (writer index mismatch)";
         case LBR_SEQUENCE_EINCCHANNELBUF:
-            return "LBR_SEQUENCE_EINCCHANNELBUF (too many channels, increase CHANNEL_BUFFER_MAX_COUNT)";
+            return "LBR_SEQUENCE_EINCCHANNELBUF (too many channels for the reserved channel buffer capacity)";
+        case LBR_SEQUENCE_ENOKEYFRAMES:
+            return "LBR_SEQUENCE_ENOKEYFRAMES (sequence keyframe index not built)";
+        case LBR_SEQUENCE_ETOOLONG:
+            return "LBR_SEQUENCE_ETOOLONG (sequence has too many frames to index or allocate)";
 
         case LBR_PLAYER_EUNSUPEXT:
             return "LBR_PLAYER_EUNSUPEXT (unsupported file extension)";
@@ -67,7 +71,7 @@ char *lbr_error_string(int err) {
             return "LBR_PLAYER_EEMPTYSHOW (show file is empty)";
 
         case LBR_ENCODE_EBUFFERTOOSMALL:
-            return "LBR_ENCODE_EBUFFERTOOSMALL (encoding buffer is too small, increase ENCODE_BUFFER_MAX_LENGTH)";
+            return "LBR_ENCODE_EBUFFERTOOSMALL (encoding buffer is too small, increase ENCODE_BUFFER_CHANNEL_LENGTH)";
         case LBR_ENCODE_EUNSUPACTION:
             return "LBR_ENCODE_EUNSUPACTION (unsupported action)";
 
@@ -79,6 +83,18 @@ char *lbr_error_string(int err) {
         case LBR_MINIFY_EUNCONDATA:
             return "LBR_MINIFY_EUNCONDATA (unconsumed frame data)";
 
+        case LBR_COMPOSITOR_ETOOMANYLAYERS:
+            return "LBR_COMPOSITOR_ETOOMANYLAYERS (too many layers, increase COMPOSITOR_MAX_LAYERS)";
+
+        case LBR_BRIGHTNESS_EUNKNOWNCURVE:
+            return "LBR_BRIGHTNESS_EUNKNOWNCURVE (unknown brightness curve)";
+
+        case LBR_REALTIME_EUNSUPPORTED:
+            return "LBR_REALTIME_EUNSUPPORTED (real-time option unsupported on this platform)";
+
+        case LBR_FRAME_EPALETTEFULL:
+            return "LBR_FRAME_EPALETTEFULL (sequence has more unique frames than FRAME_PALETTE_MAX_COUNT)";
+
         default:
             return "unknown LBR error";
     }
@@ -34,6 +34,8 @@
 #define LBR_SEQUENCE_ENOCHANNELS    6
 #define LBR_SEQUENCE_EWRITEINDEX    7
 #define LBR_SEQUENCE_EINCCHANNELBUF 8
+#define LBR_SEQUENCE_ENOKEYFRAMES   17
+#define LBR_SEQUENCE_ETOOLONG       21
 
 #define LBR_PLAYER_EUNSUPEXT        9
 #define LBR_PLAYER_EBADEXT          10
@@ -47,6 +49,14 @@
 
 #define LBR_MINIFY_EUNCONDATA       16
 
+#define LBR_COMPOSITOR_ETOOMANYLAYERS 18
+
+#define LBR_BRIGHTNESS_EUNKNOWNCURVE  19
+
+#define LBR_REALTIME_EUNSUPPORTED     20
+
+#define LBR_FRAME_EPALETTEFULL        22
+
 void lbr_perror(int err,
                 const char *msg);
 
@@ -25,16 +25,11 @@
 
 #include <string.h>
 
+#include "ctx.h"
 #include "err/lbr.h"
 
-#define FILE_LINE_BUFFER_MAX_LENGTH 256
-
-// this is unsafe, but it avoids dynamic allocations
-//  assume any single line, each pointing to a file, is no more than 256 bytes
-// this is a reused, singleton buffer and assumes no multi-threaded access
-static char file_line_buffer[FILE_LINE_BUFFER_MAX_LENGTH];
-
-int file_read_line(FILE *file,
+int file_read_line(struct libreorama_ctx *ctx,
+                   FILE *file,
                    char **out) {
     char   *read_line = NULL;
     size_t read_len   = 0;
@@ -52,15 +47,15 @@ int file_read_line(FILE *file,
             read_len--;
         }
 
-        // copy the read_line into the reused buffer
+        // copy the read_line into the context's reused buffer
         // the pointer returned by fgetln does not persist
-        strncpy(file_line_buffer, read_line, read_len);
+        strncpy(ctx->file_line_buffer, read_line, read_len);
 
         // ensure the copied string is null terminated
-        file_line_buffer[read_len] = 0;
+        ctx->file_line_buffer[read_len] = 0;
 
         // copy the final state to the out params
-        *out = &file_line_buffer[0];
+        *out = &ctx->file_line_buffer[0];
 
         return 0;
     }
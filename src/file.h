@@ -26,7 +26,14 @@
 
 #include <stdio.h>
 
-int file_read_line(FILE *file,
+// this is unsafe, but it avoids dynamic allocations
+//  assume any single line, each pointing to a file, is no more than 256 bytes
+#define FILE_LINE_BUFFER_MAX_LENGTH 256
+
+struct libreorama_ctx;
+
+int file_read_line(struct libreorama_ctx *ctx,
+                   FILE *file,
                    char **out);
 
 #endif //LIBREORAMA_FILE_H
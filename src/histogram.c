@@ -0,0 +1,119 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "histogram.h"
+
+static const struct histogram_t HISTOGRAM_EMPTY;
+
+static size_t histogram_bucket_of(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKET_COUNT) {
+        return (size_t) value;
+    }
+
+    // the highest set bit selects the power of two range
+    // the following HISTOGRAM_SUB_BUCKET_BITS bits select the linear bucket within it
+    const unsigned int msb   = 63u - (unsigned int) __builtin_clzll(value);
+    const unsigned int shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+
+    return (size_t) (msb - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKET_COUNT + (size_t) ((value >> shift) - HISTOGRAM_SUB_BUCKET_COUNT);
+}
+
+static uint64_t histogram_bucket_highest_value(size_t bucket) {
+    if (bucket < HISTOGRAM_SUB_BUCKET_COUNT) {
+        return bucket;
+    }
+
+    const unsigned int range = (unsigned int) (bucket / HISTOGRAM_SUB_BUCKET_COUNT);
+    const unsigned int shift = range - 1;
+    const uint64_t     base  = (uint64_t) (HISTOGRAM_SUB_BUCKET_COUNT + bucket % HISTOGRAM_SUB_BUCKET_COUNT) << shift;
+
+    return base + ((uint64_t) 1 << shift) - 1;
+}
+
+void histogram_reset(struct histogram_t *histogram) {
+    *histogram = HISTOGRAM_EMPTY;
+}
+
+void histogram_record(struct histogram_t *histogram,
+                      uint64_t value) {
+    histogram->counts[histogram_bucket_of(value)]++;
+
+    if (histogram->total_count == 0 || value < histogram->min) {
+        histogram->min = value;
+    }
+
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+
+    histogram->total_count++;
+    histogram->sum += value;
+}
+
+uint64_t histogram_percentile(const struct histogram_t *histogram,
+                              double percentile) {
+    if (histogram->total_count == 0) {
+        return 0;
+    }
+
+    // the rank of the value at the percentile, rounded up so 100 selects the last value
+    unsigned long rank = (unsigned long) ((percentile / 100.0) * (double) histogram->total_count + 0.5);
+
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    unsigned long seen = 0;
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        seen += histogram->counts[i];
+
+        if (seen >= rank) {
+            // the bucket's highest value may overshoot the largest recorded value
+            const uint64_t value = histogram_bucket_highest_value(i);
+
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+void histogram_print(const struct histogram_t *histogram,
+                     const char *name,
+                     const char *unit,
+                     FILE *file) {
+    const uint64_t mean = histogram->total_count > 0 ? histogram->sum / histogram->total_count : 0;
+
+    fprintf(file, "%-14s n=%-8lu min=%llu mean=%llu p50=%llu p90=%llu p99=%llu p99.9=%llu max=%llu (%s)\n",
+            name,
+            histogram->total_count,
+            (unsigned long long) histogram->min,
+            (unsigned long long) mean,
+            (unsigned long long) histogram_percentile(histogram, 50),
+            (unsigned long long) histogram_percentile(histogram, 90),
+            (unsigned long long) histogram_percentile(histogram, 99),
+            (unsigned long long) histogram_percentile(histogram, 99.9),
+            (unsigned long long) histogram->max,
+            unit);
+}
@@ -0,0 +1,61 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LIBREORAMA_HISTOGRAM_H
+#define LIBREORAMA_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// histogram_t is a log-linear (HDR style) histogram of unsigned 64 bit values
+// each power of two range is split into HISTOGRAM_SUB_BUCKET_COUNT linear buckets
+// values below HISTOGRAM_SUB_BUCKET_COUNT * 2 are exact, larger values are within ~6%
+// recording is a few integer instructions, so it may be left enabled during playback
+#define HISTOGRAM_SUB_BUCKET_BITS  4
+#define HISTOGRAM_SUB_BUCKET_COUNT (1u << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKET_COUNT     ((64 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKET_COUNT)
+
+struct histogram_t {
+    unsigned long counts[HISTOGRAM_BUCKET_COUNT];
+    unsigned long total_count;
+    uint64_t      min;
+    uint64_t      max;
+    uint64_t      sum;
+};
+
+void histogram_reset(struct histogram_t *histogram);
+
+void histogram_record(struct histogram_t *histogram,
+                      uint64_t value);
+
+// returns the highest value equivalent to the given percentile (0-100), or 0 if empty
+uint64_t histogram_percentile(const struct histogram_t *histogram,
+                              double percentile);
+
+// prints a single line summary of count, min, mean, percentiles and max
+void histogram_print(const struct histogram_t *histogram,
+                     const char *name,
+                     const char *unit,
+                     FILE *file);
+
+#endif //LIBREORAMA_HISTOGRAM_H
@@ -23,6 +23,8 @@
  */
 #include "interval.h"
 
+#include <errno.h>
+
 #include "err/lbr.h"
 
 #define INTERVAL_NS_IN_S 1000000000
@@ -89,9 +91,22 @@ int interval_sleep(struct interval_t *interval) {
 
     interval->sleep_duration_goal = interval->sleep_duration;
 
-    if (nanosleep(&interval->sleep_duration, NULL)) {
-        return LBR_EERRNO;
+    struct timespec remaining = interval->sleep_duration;
+
+    // signals (such as SIGUSR1, see main.c) interrupt the sleep, resume it with the remaining time
+    while (nanosleep(&remaining, &remaining)) {
+        if (errno != EINTR) {
+            return LBR_EERRNO;
+        }
     }
 
     return 0;
 }
+
+long long interval_lateness_ns(const struct interval_t *interval) {
+    struct timespec lateness;
+
+    timespec_sub(interval->sleep_duration_goal, interval->sleep_duration_spent, &lateness);
+
+    return (long long) lateness.tv_sec * INTERVAL_NS_IN_S + lateness.tv_nsec;
+}
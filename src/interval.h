@@ -43,4 +43,8 @@ int interval_wake(struct interval_t *interval);
 
 int interval_sleep(struct interval_t *interval);
 
+// returns how far the most recent sleep overran its requested duration, in nanoseconds
+// this is negative if it woke early, and 0 before the first sleep
+long long interval_lateness_ns(const struct interval_t *interval);
+
 #endif //LIBREORAMA_INTERVAL_H
@@ -0,0 +1,77 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "brightness.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <lightorama/brightness_curve.h>
+
+#include "../ctx.h"
+#include "../err/lbr.h"
+
+lor_brightness_t BRIGHTNESS_CURVE_TABLES[BRIGHTNESS_CURVE_COUNT][UCHAR_MAX + 1];
+
+unsigned char BRIGHTNESS_INTENSITY_TABLE[UCHAR_MAX + 1];
+
+static const char *BRIGHTNESS_CURVE_NAMES[BRIGHTNESS_CURVE_COUNT] = {
+        "squared",
+        "linear",
+        "gamma",
+};
+
+void brightness_tables_init(void) {
+    // all float math happens once here, encoding & loading are then a single table load
+    for (int i = 0; i <= UCHAR_MAX; i++) {
+        const float normal = (float) i / 255.0f;
+
+        BRIGHTNESS_CURVE_TABLES[BRIGHTNESS_CURVE_SQUARED][i] = lor_brightness_curve_squared(normal);
+        BRIGHTNESS_CURVE_TABLES[BRIGHTNESS_CURVE_LINEAR][i]  = lor_brightness_curve_linear(normal);
+        BRIGHTNESS_CURVE_TABLES[BRIGHTNESS_CURVE_GAMMA][i]   = lor_brightness_curve_linear(powf(normal, BRIGHTNESS_CURVE_GAMMA_EXPONENT));
+
+        if (i <= BRIGHTNESS_MAX_INTENSITY) {
+            BRIGHTNESS_INTENSITY_TABLE[i] = BRIGHTNESS_OF_INTENSITY(i);
+        } else {
+            BRIGHTNESS_INTENSITY_TABLE[i] = UCHAR_MAX;
+        }
+    }
+}
+
+int brightness_curve_parse(const char *name,
+                           enum brightness_curve_t *curve) {
+    for (int i = 0; i < BRIGHTNESS_CURVE_COUNT; i++) {
+        if (strcmp(name, BRIGHTNESS_CURVE_NAMES[i]) == 0) {
+            *curve = (enum brightness_curve_t) i;
+            return 0;
+        }
+    }
+
+    return LBR_BRIGHTNESS_EUNKNOWNCURVE;
+}
+
+void brightness_set_unit_curve(struct libreorama_ctx *ctx,
+                               lor_unit_t unit,
+                               enum brightness_curve_t curve) {
+    ctx->unit_brightness_curve[unit] = (unsigned char) curve;
+}
@@ -0,0 +1,77 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LIBREORAMA_BRIGHTNESS_H
+#define LIBREORAMA_BRIGHTNESS_H
+
+#include <limits.h>
+
+#include <lightorama/protocol.h>
+
+#include "fixed.h"
+
+// brightness curves map a 0-255 brightness onto the protocol's lor_brightness_t
+// the zero value is the default for all units in a freshly initialized ctx
+enum brightness_curve_t {
+    BRIGHTNESS_CURVE_SQUARED,
+    BRIGHTNESS_CURVE_LINEAR,
+    BRIGHTNESS_CURVE_GAMMA,
+    BRIGHTNESS_CURVE_COUNT,
+};
+
+#define BRIGHTNESS_CURVE_GAMMA_EXPONENT 2.2f
+
+// precomputed by #brightness_tables_init, indexed by [curve][brightness]
+extern lor_brightness_t BRIGHTNESS_CURVE_TABLES[BRIGHTNESS_CURVE_COUNT][UCHAR_MAX + 1];
+
+// LMS files use 0-100 for brightness scales
+// normalize the value and scale it against 255 (full byte), truncating
+// the integer form is exact for all intensities in 0-100, see bench/fixed.c
+#define BRIGHTNESS_OF_INTENSITY_FIXED(intensity) ((unsigned char) (((unsigned int) (intensity) * 255u) / 100u))
+#define BRIGHTNESS_OF_INTENSITY_FLOAT(intensity) ((unsigned char) (((float) (intensity) / 100.0f) * 255))
+
+#ifdef LIBREORAMA_FIXED_POINT
+#define BRIGHTNESS_OF_INTENSITY(intensity) BRIGHTNESS_OF_INTENSITY_FIXED(intensity)
+#else
+#define BRIGHTNESS_OF_INTENSITY(intensity) BRIGHTNESS_OF_INTENSITY_FLOAT(intensity)
+#endif
+
+#define BRIGHTNESS_MAX_INTENSITY 100
+
+// precomputed by #brightness_tables_init, maps LMS 0-100 intensities to a 0-255 brightness
+// intensities above 100 are clamped to full brightness
+extern unsigned char BRIGHTNESS_INTENSITY_TABLE[UCHAR_MAX + 1];
+
+// must be called once per process, prior to loading or encoding any sequence
+void brightness_tables_init(void);
+
+int brightness_curve_parse(const char *name,
+                           enum brightness_curve_t *curve);
+
+struct libreorama_ctx;
+
+void brightness_set_unit_curve(struct libreorama_ctx *ctx,
+                               lor_unit_t unit,
+                               enum brightness_curve_t curve);
+
+#endif //LIBREORAMA_BRIGHTNESS_H
@@ -23,44 +23,214 @@
  */
 #include "channel.h"
 
+#include <stdlib.h>
 #include <string.h>
 
+#include "../ctx.h"
 #include "../err/lbr.h"
 
-struct channel_t channel_buffer[CHANNEL_BUFFER_MAX_COUNT];
-size_t           channel_buffer_index;
+static size_t channel_buffer_slice_length(size_t length) {
+    return (length + CHANNEL_BUFFER_SLICE_ALIGNMENT - 1) / CHANNEL_BUFFER_SLICE_ALIGNMENT * CHANNEL_BUFFER_SLICE_ALIGNMENT;
+}
+
+static void *channel_buffer_slice(unsigned char **cursor,
+                                  size_t length) {
+    void *slice = *cursor;
+
+    *cursor += channel_buffer_slice_length(length);
+
+    return slice;
+}
+
+int channel_buffer_reserve(struct libreorama_ctx *ctx,
+                           size_t count) {
+    // the current block may already fit the reservation
+    // a reservation always precedes any requests, so the block is not in use
+    if (ctx->channel_block != NULL && ctx->channel_buffer_capacity >= count) {
+        channel_buffer_reset(ctx);
+        channel_output_state_reset(ctx);
+        return 0;
+    }
+
+    channel_buffer_free(ctx);
+
+    if (count == 0) {
+        return 0;
+    }
+
+    // the encode buffer must fit a single frame of output for every channel (see encode.h)
+    const size_t encode_length = ENCODE_BUFFER_BASE_LENGTH + ENCODE_BUFFER_CHANNEL_LENGTH * count;
+
+    // commands never outnumber the channels (see #minify_push_command)
+    // the broadcast dedup scratch holds MINIFY_BROADCAST_DEDUP_FLAG_COUNT flags per channel or command
+    const size_t length = channel_buffer_slice_length(sizeof(struct channel_t) * count) +
+                          channel_buffer_slice_length(sizeof(struct channel_output_state_t) * count) +
+                          channel_buffer_slice_length(sizeof(struct frame_t) * count) +
+                          channel_buffer_slice_length(sizeof(frame_palette_index_t) * count) +
+                          channel_buffer_slice_length(sizeof(struct minify_command_t) * count) +
+                          channel_buffer_slice_length(sizeof(struct keyframe_state_t) * count) +
+                          channel_buffer_slice_length(sizeof(struct frame_t) * count) +
+                          channel_buffer_slice_length(sizeof(size_t) * count) +
+                          channel_buffer_slice_length(sizeof(bool) * count * MINIFY_BROADCAST_DEDUP_FLAG_COUNT) +
+                          channel_buffer_slice_length(encode_length);
+
+    // calloc ensures the output state begins zeroed, matching #channel_output_state_reset
+    unsigned char *block = calloc(1, length);
+
+    if (block == NULL) {
+        return LBR_EERRNO;
+    }
 
-int channel_buffer_request(lor_unit_t unit,
+    unsigned char *cursor = block;
+
+    ctx->channel_buffer              = channel_buffer_slice(&cursor, sizeof(struct channel_t) * count);
+    ctx->output_state                = channel_buffer_slice(&cursor, sizeof(struct channel_output_state_t) * count);
+    ctx->upcoming_frames_buffer      = channel_buffer_slice(&cursor, sizeof(struct frame_t) * count);
+    ctx->upcoming_palette_buffer     = channel_buffer_slice(&cursor, sizeof(frame_palette_index_t) * count);
+    ctx->command_buffer              = channel_buffer_slice(&cursor, sizeof(struct minify_command_t) * count);
+    ctx->restore_state_buffer        = channel_buffer_slice(&cursor, sizeof(struct keyframe_state_t) * count);
+    ctx->restore_frame_buffer        = channel_buffer_slice(&cursor, sizeof(struct frame_t) * count);
+    ctx->broadcast_dedup_corrections = channel_buffer_slice(&cursor, sizeof(size_t) * count);
+    ctx->broadcast_dedup_flags       = channel_buffer_slice(&cursor, sizeof(bool) * count * MINIFY_BROADCAST_DEDUP_FLAG_COUNT);
+    ctx->encode_buffer               = channel_buffer_slice(&cursor, encode_length);
+
+    ctx->channel_block           = block;
+    ctx->channel_block_length    = length;
+    ctx->channel_buffer_capacity = count;
+    ctx->encode_buffer_capacity  = encode_length;
+
+    channel_buffer_reset(ctx);
+
+    return 0;
+}
+
+int channel_buffer_request(struct libreorama_ctx *ctx,
+                           lor_unit_t unit,
                            lor_channel_t circuit,
-                           frame_index_t frame_count,
                            struct channel_t **channel) {
-    if (channel_buffer_index >= CHANNEL_BUFFER_MAX_COUNT) {
+    // the capacity is fixed by #channel_buffer_reserve, requests never reallocate
+    if (ctx->channel_buffer_index >= ctx->channel_buffer_capacity) {
         return LBR_SEQUENCE_EINCCHANNELBUF;
     }
 
-    struct channel_t *checkout = &channel_buffer[channel_buffer_index];
+    struct channel_t *checkout = &ctx->channel_buffer[ctx->channel_buffer_index];
 
     // always initialize channel_t since they can be reused
+    // this also empties its timeline, every frame of which is unset
     memset(checkout, 0, sizeof(struct channel_t));
 
-    // checkout a frame buffer
-    int err;
-    if ((err = frame_buffer_request(frame_count, &checkout->frame_data))) {
-        return err;
-    }
-
     // by requiring params, this ensures any downstream
     //  usages are forced to initialize these values
     checkout->unit    = unit;
     checkout->circuit = circuit;
 
     *channel = checkout;
-    channel_buffer_index++;
+    ctx->channel_buffer_index++;
 
     return 0;
 }
 
-void channel_buffer_reset() {
+static int channel_compare(const void *a,
+                           const void *b) {
+    const struct channel_t *channel_a = (struct channel_t *) a;
+    const struct channel_t *channel_b = (struct channel_t *) b;
+
+    if (channel_a->unit != channel_b->unit) {
+        return channel_a->unit - channel_b->unit;
+    }
+
+    return channel_a->circuit - channel_b->circuit;
+}
+
+void channel_buffer_sort(struct libreorama_ctx *ctx) {
+    // sort channels by unit+circuit in ascending order
+    // this allows iteration loops to easily detect unit "breaks"
+    // and keeps channel_buffer indexes aligned with output_state & keyframe indexes
+    qsort(ctx->channel_buffer, ctx->channel_buffer_index, sizeof(struct channel_t), channel_compare);
+
+    // index each unit's contiguous range of channels for #channel_buffer_find
+    memset(ctx->channel_units, 0, sizeof(ctx->channel_units));
+
+    for (size_t i = 0; i < ctx->channel_buffer_index; i++) {
+        struct channel_unit_t *channel_unit = &ctx->channel_units[ctx->channel_buffer[i].unit];
+
+        if (channel_unit->count == 0) {
+            channel_unit->start = i;
+        }
+
+        channel_unit->count++;
+    }
+}
+
+size_t channel_buffer_find(const struct libreorama_ctx *ctx,
+                           lor_unit_t unit,
+                           lor_channel_t circuit) {
+    const struct channel_unit_t channel_unit = ctx->channel_units[unit];
+
+    if (channel_unit.count == 0) {
+        return CHANNEL_BUFFER_NOT_FOUND;
+    }
+
+    const struct channel_t *channels = &ctx->channel_buffer[channel_unit.start];
+
+    if (circuit < channels[0].circuit) {
+        return CHANNEL_BUFFER_NOT_FOUND;
+    }
+
+    // units typically use a contiguous run of circuits, which are directly indexed by offset
+    const size_t offset = (size_t) (circuit - channels[0].circuit);
+
+    if (offset < channel_unit.count && channels[offset].circuit == circuit) {
+        return channel_unit.start + offset;
+    }
+
+    // otherwise binary search the unit's circuits, which are sorted in ascending order
+    size_t low  = 0;
+    size_t high = channel_unit.count;
+
+    while (low < high) {
+        const size_t mid = low + (high - low) / 2;
+
+        if (channels[mid].circuit < circuit) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (low < channel_unit.count && channels[low].circuit == circuit) {
+        return channel_unit.start + low;
+    }
+
+    return CHANNEL_BUFFER_NOT_FOUND;
+}
+
+void channel_buffer_reset(struct libreorama_ctx *ctx) {
     // reset index back to 0 for next checkout request
-    channel_buffer_index = 0;
+    ctx->channel_buffer_index = 0;
+
+    memset(ctx->channel_units, 0, sizeof(ctx->channel_units));
+}
+
+void channel_buffer_free(struct libreorama_ctx *ctx) {
+    free(ctx->channel_block);
+
+    // release any dangling pointers and avoid double free
+    ctx->channel_block               = NULL;
+    ctx->channel_block_length        = 0;
+    ctx->channel_buffer_capacity     = 0;
+    ctx->channel_buffer              = NULL;
+    ctx->output_state                = NULL;
+    ctx->upcoming_frames_buffer      = NULL;
+    ctx->upcoming_palette_buffer     = NULL;
+    ctx->command_buffer              = NULL;
+    ctx->restore_state_buffer        = NULL;
+    ctx->restore_frame_buffer        = NULL;
+    ctx->broadcast_dedup_corrections = NULL;
+    ctx->broadcast_dedup_flags       = NULL;
+    ctx->encode_buffer               = NULL;
+    ctx->encode_buffer_capacity      = 0;
+    ctx->encode_buffer_index         = 0;
+
+    channel_buffer_reset(ctx);
 }
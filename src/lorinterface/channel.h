@@ -25,27 +25,54 @@
 #define LIBREORAMA_CHANNEL_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include <lightorama/protocol.h>
 
 #include "frame.h"
+#include "timeline.h"
 
-#define CHANNEL_BUFFER_MAX_COUNT 128
+// channel storage is sized by #channel_buffer_reserve once a loader knows its channel count
+// a single allocation is sliced into every channel indexed buffer (see ctx.h)
+//  and is never resized during playback, only replaced by the next reservation
+// slices are padded to CHANNEL_BUFFER_SLICE_ALIGNMENT so each buffer is suitably aligned
+#define CHANNEL_BUFFER_SLICE_ALIGNMENT 16
+
+// returned by #channel_buffer_find when no channel matches
+#define CHANNEL_BUFFER_NOT_FOUND SIZE_MAX
+
+struct libreorama_ctx;
 
 struct channel_t {
-    lor_unit_t     unit;
-    lor_channel_t  circuit;
-    struct frame_t *frame_data;
+    lor_unit_t        unit;
+    lor_channel_t     circuit;
+    struct timeline_t timeline;
+};
+
+// each unit's channels as a range of the sorted channel_buffer, built by #channel_buffer_sort
+struct channel_unit_t {
+    size_t start;
+    size_t count;
 };
 
-extern struct channel_t channel_buffer[CHANNEL_BUFFER_MAX_COUNT];
-extern size_t           channel_buffer_index;
+int channel_buffer_reserve(struct libreorama_ctx *ctx,
+                           size_t count);
 
-int channel_buffer_request(lor_unit_t unit,
+// channels are requested with an empty timeline, which loaders fill using #timeline_store
+int channel_buffer_request(struct libreorama_ctx *ctx,
+                           lor_unit_t unit,
                            lor_channel_t circuit,
-                           frame_index_t frame_count,
                            struct channel_t **channel);
 
-void channel_buffer_reset();
+void channel_buffer_sort(struct libreorama_ctx *ctx);
+
+size_t channel_buffer_find(const struct libreorama_ctx *ctx,
+                           lor_unit_t unit,
+                           lor_channel_t circuit);
+
+void channel_buffer_reset(struct libreorama_ctx *ctx);
+
+void channel_buffer_free(struct libreorama_ctx *ctx);
 
 #endif //LIBREORAMA_CHANNEL_H
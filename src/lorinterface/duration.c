@@ -0,0 +1,42 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "duration.h"
+
+lor_duration_t DURATION_TABLE[DURATION_TABLE_MAX_CS + 1];
+
+void duration_table_init(void) {
+    // liblightorama only accepts durations in (float) seconds
+    // each possible centisecond duration is converted once here, instead of per encoded fade
+    for (unsigned short i = 0; i <= DURATION_TABLE_MAX_CS; i++) {
+        DURATION_TABLE[i] = DURATION_OF_CS_FLOAT(i);
+    }
+}
+
+lor_duration_t duration_of_cs_fixed(unsigned short duration_cs) {
+    if (duration_cs <= DURATION_TABLE_MAX_CS) {
+        return DURATION_TABLE[duration_cs];
+    }
+
+    return DURATION_OF_CS_FLOAT(duration_cs);
+}
@@ -0,0 +1,50 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LIBREORAMA_DURATION_H
+#define LIBREORAMA_DURATION_H
+
+#include <lightorama/protocol.h>
+
+#include "fixed.h"
+
+// fade durations up to DURATION_TABLE_MAX_CS are precomputed by #duration_table_init
+// longer durations fall back to #lor_duration_of
+#define DURATION_TABLE_MAX_CS 6000
+
+#define DURATION_OF_CS_FLOAT(duration_cs) (lor_duration_of((float) (duration_cs) / 100.0f))
+
+extern lor_duration_t DURATION_TABLE[DURATION_TABLE_MAX_CS + 1];
+
+// must be called once per process, prior to encoding any sequence
+void duration_table_init(void);
+
+lor_duration_t duration_of_cs_fixed(unsigned short duration_cs);
+
+#ifdef LIBREORAMA_FIXED_POINT
+#define DURATION_OF_CS(duration_cs) (duration_of_cs_fixed(duration_cs))
+#else
+#define DURATION_OF_CS(duration_cs) DURATION_OF_CS_FLOAT(duration_cs)
+#endif
+
+#endif //LIBREORAMA_DURATION_H
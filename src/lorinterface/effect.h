@@ -29,7 +29,9 @@
 struct frame_effect_fade_t {
     unsigned char  from;
     unsigned char  to;
-    lor_duration_t duration;
+    // stored as centiseconds and converted into a lor_duration_t by encode.h
+    // this allows the remaining duration of a partially elapsed fade to be computed
+    unsigned short duration_cs;
 } __attribute__((packed));
 
 #endif //LIBREORAMA_EFFECT_H
@@ -24,72 +24,194 @@
 #include "encode.h"
 
 #include <lightorama/io.h>
-#include <lightorama/brightness_curve.h>
 
+#include "../ctx.h"
 #include "../err/lbr.h"
+#include "brightness.h"
+#include "duration.h"
+
+// brightness curves are precomputed and selected per unit, see brightness.h
+#define LORENCODE_BRIGHTNESS(curve, brightness) ((curve)[(brightness)])
+
+// fade durations are stored in centiseconds, see struct frame_effect_fade_t
+#define LORENCODE_DURATION(duration_cs) (DURATION_OF_CS(duration_cs))
+
+const char *ENCODE_STATS_COMMAND_NAMES[ENCODE_STATS_COMMAND_COUNT] = {
+        "set_brightness",
+        "fade",
+        "on",
+        "shimmer",
+        "twinkle",
+        "heartbeat",
+        "reset",
+        "unit_off",
+};
+
+static void encode_stats_add(struct libreorama_ctx *ctx,
+                             lor_unit_t unit,
+                             enum encode_stats_command_t command,
+                             size_t written) {
+    struct encode_stats_t *stats = ctx->encode_stats;
+
+    if (stats != NULL) {
+        stats->unit_bytes[unit] += written;
+        stats->command_bytes[command] += written;
+        stats->command_count[command]++;
+    }
+}
 
-#define LORENCODE_BRIGHTNESS(brightness) ((lor_brightness_curve_squared((float) (brightness) / 255.0f)))
+unsigned char *encode_buffer_write_index(struct libreorama_ctx *ctx) {
+    return &ctx->encode_buffer[ctx->encode_buffer_index];
+}
 
-unsigned char encode_buffer[ENCODE_BUFFER_MAX_LENGTH];
-size_t        encode_buffer_index;
+int encode_buffer_advance(struct libreorama_ctx *ctx,
+                          size_t len) {
+    ctx->encode_buffer_index += len;
 
-unsigned char *encode_buffer_write_index() {
-    return &encode_buffer[encode_buffer_index];
-}
+    if (ctx->encode_buffer_index > ctx->encode_buffer_capacity) {
+        return LBR_ENCODE_EBUFFERTOOSMALL;
+    }
 
-int encode_buffer_advance(size_t len) {
-    encode_buffer_index += len;
+    return 0;
+}
 
-    if (encode_buffer_index > ENCODE_BUFFER_MAX_LENGTH) {
+static int encode_buffer_ensure(struct libreorama_ctx *ctx) {
+    // commands are written before being measured, so the buffer must fit the longest possible command
+    // this also rejects writes to a context whose encode buffer has not been reserved
+    if (ctx->encode_buffer == NULL || ctx->encode_buffer_capacity - ctx->encode_buffer_index < ENCODE_FRAME_MAX_LENGTH) {
         return LBR_ENCODE_EBUFFERTOOSMALL;
     }
 
     return 0;
 }
 
-void encode_buffer_reset() {
-    encode_buffer_index = 0;
+void encode_buffer_reset(struct libreorama_ctx *ctx) {
+    ctx->encode_buffer_index = 0;
 }
 
-int encode_frame(lor_unit_t unit,
-                 enum lor_channel_type_t channel_type,
-                 lor_channel_t channel,
-                 struct frame_t frame) {
+// writes the frame into buf, returning the written length or 0 if the action is unsupported
+static size_t encode_frame_write(lor_unit_t unit,
+                                 enum brightness_curve_t curve_type,
+                                 enum lor_channel_type_t channel_type,
+                                 lor_channel_t channel,
+                                 unsigned char channel_bank,
+                                 struct frame_t frame,
+                                 unsigned char *buf,
+                                 enum encode_stats_command_t *command) {
+    const lor_brightness_t *curve = BRIGHTNESS_CURVE_TABLES[curve_type];
+
     size_t written;
 
     switch (frame.action) {
         case LOR_ACTION_CHANNEL_SET_BRIGHTNESS:
-            written = lor_write_channel_set_brightness(unit, channel_type, channel, LORENCODE_BRIGHTNESS(frame.fade.to), encode_buffer_write_index());
+            *command = ENCODE_STATS_SET_BRIGHTNESS;
+            written = lor_write_channel_set_brightness(unit, channel_type, channel, LORENCODE_BRIGHTNESS(curve, frame.set_brightness), buf);
             break;
         case LOR_ACTION_CHANNEL_FADE:
-            written = lor_write_channel_fade(unit, channel_type, channel, LORENCODE_BRIGHTNESS(frame.fade.from), LORENCODE_BRIGHTNESS(frame.fade.to), frame.fade.duration, encode_buffer_write_index());
+            *command = ENCODE_STATS_FADE;
+            written = lor_write_channel_fade(unit, channel_type, channel, LORENCODE_BRIGHTNESS(curve, frame.fade.from), LORENCODE_BRIGHTNESS(curve, frame.fade.to), LORENCODE_DURATION(frame.fade.duration_cs), buf);
             break;
         case LOR_ACTION_CHANNEL_ON:
+            *command = ENCODE_STATS_ON;
+            written = lor_write_channel_action(unit, channel_type, channel, frame.action, buf);
+            break;
         case LOR_ACTION_CHANNEL_SHIMMER:
+            *command = ENCODE_STATS_SHIMMER;
+            written = lor_write_channel_action(unit, channel_type, channel, frame.action, buf);
+            break;
         case LOR_ACTION_CHANNEL_TWINKLE:
-            written = lor_write_channel_action(unit, channel_type, channel, frame.action, encode_buffer_write_index());
+            *command = ENCODE_STATS_TWINKLE;
+            written = lor_write_channel_action(unit, channel_type, channel, frame.action, buf);
             break;
         default:
-            return LBR_ENCODE_EUNSUPACTION;
+            return 0;
+    }
+
+    // the first bank is addressed by a plain channel mask
+    // other banks flag the command byte and insert the bank index ahead of the trailing terminator
+    if (channel_bank > 0 && channel_type != LOR_CHANNEL_ID) {
+        buf[ENCODE_COMMAND_BYTE_OFFSET] |= ENCODE_CHANNEL_BANK_FLAG;
+        buf[written - 1] = channel_bank;
+        buf[written]     = 0;
+
+        written++;
     }
 
+    return written;
+}
+
+int encode_frame(struct libreorama_ctx *ctx,
+                 lor_unit_t unit,
+                 enum lor_channel_type_t channel_type,
+                 lor_channel_t channel,
+                 unsigned char channel_bank,
+                 struct frame_t frame) {
+    return encode_frame_curve(ctx, unit, (enum brightness_curve_t) ctx->unit_brightness_curve[unit], channel_type, channel, channel_bank, frame);
+}
+
+int encode_frame_curve(struct libreorama_ctx *ctx,
+                       lor_unit_t unit,
+                       enum brightness_curve_t curve,
+                       enum lor_channel_type_t channel_type,
+                       lor_channel_t channel,
+                       unsigned char channel_bank,
+                       struct frame_t frame) {
+    enum encode_stats_command_t command;
+
     int err;
-    if ((err = encode_buffer_advance(written))) {
+    if ((err = encode_buffer_ensure(ctx))) {
+        return err;
+    }
+
+    const size_t written = encode_frame_write(unit, curve, channel_type, channel, channel_bank, frame, encode_buffer_write_index(ctx), &command);
+
+    if (written == 0) {
+        return LBR_ENCODE_EUNSUPACTION;
+    }
+
+    encode_stats_add(ctx, unit, command, written);
+
+    if ((err = encode_buffer_advance(ctx, written))) {
         return err;
     }
 
     return 0;
 }
 
-int encode_heartbeat_frame(frame_index_t frame_index,
+size_t encode_frame_length(lor_unit_t unit,
+                           enum brightness_curve_t curve,
+                           enum lor_channel_type_t channel_type,
+                           lor_channel_t channel,
+                           unsigned char channel_bank,
+                           struct frame_t frame) {
+    unsigned char               buf[ENCODE_FRAME_MAX_LENGTH];
+    enum encode_stats_command_t command;
+
+    return encode_frame_write(unit, curve, channel_type, channel, channel_bank, frame, buf, &command);
+}
+
+size_t encode_unit_off_frame_length(lor_unit_t unit) {
+    unsigned char buf[ENCODE_FRAME_MAX_LENGTH];
+
+    return lor_write_unit_action(unit, LOR_ACTION_UNIT_OFF, buf);
+}
+
+int encode_heartbeat_frame(struct libreorama_ctx *ctx,
+                           frame_index_t frame_index,
                            unsigned short step_time_ms) {
     // automatically push heartbeat messages into the encode buffer
-    // this is timed for every 500ms, based off the frame index
-    if (frame_index % (500 / step_time_ms) == 0) {
-        size_t written = lor_write_heartbeat(encode_buffer_write_index());
-
+    // this is timed for every ENCODE_HEARTBEAT_INTERVAL_MS, based off the frame index
+    if (frame_index % (ENCODE_HEARTBEAT_INTERVAL_MS / step_time_ms) == 0) {
         int err;
-        if ((err = encode_buffer_advance(written))) {
+        if ((err = encode_buffer_ensure(ctx))) {
+            return err;
+        }
+
+        size_t written = lor_write_heartbeat(encode_buffer_write_index(ctx));
+
+        encode_stats_add(ctx, LOR_UNIT_ID_BROADCAST, ENCODE_STATS_HEARTBEAT, written);
+
+        if ((err = encode_buffer_advance(ctx, written))) {
             return err;
         }
     }
@@ -97,11 +219,35 @@ int encode_heartbeat_frame(frame_index_t frame_index,
     return 0;
 }
 
-int encode_reset_frame() {
-    size_t written = lor_write_unit_action(LOR_UNIT_ID_BROADCAST, LOR_ACTION_UNIT_OFF, encode_buffer_write_index());
+int encode_reset_frame(struct libreorama_ctx *ctx) {
+    int err;
+    if ((err = encode_buffer_ensure(ctx))) {
+        return err;
+    }
+
+    size_t written = lor_write_unit_action(LOR_UNIT_ID_BROADCAST, LOR_ACTION_UNIT_OFF, encode_buffer_write_index(ctx));
+
+    encode_stats_add(ctx, LOR_UNIT_ID_BROADCAST, ENCODE_STATS_RESET, written);
 
+    if ((err = encode_buffer_advance(ctx, written))) {
+        return err;
+    }
+
+    return 0;
+}
+
+int encode_unit_off_frame(struct libreorama_ctx *ctx,
+                          lor_unit_t unit) {
     int err;
-    if ((err = encode_buffer_advance(written))) {
+    if ((err = encode_buffer_ensure(ctx))) {
+        return err;
+    }
+
+    size_t written = lor_write_unit_action(unit, LOR_ACTION_UNIT_OFF, encode_buffer_write_index(ctx));
+
+    encode_stats_add(ctx, unit, ENCODE_STATS_UNIT_OFF, written);
+
+    if ((err = encode_buffer_advance(ctx, written))) {
         return err;
     }
 
@@ -26,26 +26,99 @@
 
 #include "../err/al.h"
 #include "../player/sequence.h"
+#include "brightness.h"
 
-#define ENCODE_BUFFER_MAX_LENGTH 4096
+#include <limits.h>
 
-extern unsigned char encode_buffer[ENCODE_BUFFER_MAX_LENGTH];
-extern size_t        encode_buffer_index;
+// the longest single command, a fade with a banked 16 bit channel mask
+#define ENCODE_FRAME_MAX_LENGTH 16
 
-unsigned char *encode_buffer_write_index();
+// the encode buffer holds a single frame's output, and is reserved alongside the channels (see channel.h)
+// each channel may need both its own command and a broadcast correction (see minify.h)
+// ENCODE_BUFFER_BASE_LENGTH leaves room for heartbeats, resets & unit off commands
+#define ENCODE_BUFFER_BASE_LENGTH    4096
+#define ENCODE_BUFFER_CHANNEL_LENGTH (ENCODE_FRAME_MAX_LENGTH * 2)
 
-int encode_buffer_advance(size_t len);
+// channel masks address circuits in banks of ENCODE_CHANNEL_BANK_SIZE
+// liblightorama only writes masks of the first bank (LOR_CHANNEL_MASK8 & LOR_CHANNEL_MASK16, see lightorama/protocol.h)
+// with ctx->channel_banks set, commands for any other bank set ENCODE_CHANNEL_BANK_FLAG in the command byte
+// and are followed by the bank index, this is an extension of liblightorama's framing and is opt in (-B)
+// since controllers must support it, otherwise units with more than 16 circuits are sent a command per channel
+#define ENCODE_CHANNEL_BANK_SIZE 16
+#define ENCODE_CHANNEL_BANK_FLAG 0x40
+#define ENCODE_CHANNEL_BANK_OF(circuit) ((unsigned char) ((circuit) / ENCODE_CHANNEL_BANK_SIZE))
 
-void encode_buffer_reset();
+// the highest circuit addressable by a LOR_CHANNEL_ID
+#define ENCODE_CHANNEL_ID_MAX 0x7F
 
-int encode_frame(lor_unit_t unit,
+// controllers expect a heartbeat at least this often, or leave network control
+#define ENCODE_HEARTBEAT_INTERVAL_MS 500
+
+// offset of the command byte (action and channel type) within an encoded command
+#define ENCODE_COMMAND_BYTE_OFFSET 2
+
+// command types tracked by encode_stats_t
+enum encode_stats_command_t {
+    ENCODE_STATS_SET_BRIGHTNESS,
+    ENCODE_STATS_FADE,
+    ENCODE_STATS_ON,
+    ENCODE_STATS_SHIMMER,
+    ENCODE_STATS_TWINKLE,
+    ENCODE_STATS_HEARTBEAT,
+    ENCODE_STATS_RESET,
+    ENCODE_STATS_UNIT_OFF,
+    ENCODE_STATS_COMMAND_COUNT,
+};
+
+// encode_stats_t accumulates the bytes written to the encode buffer by unit and command type
+// accounting is disabled unless ctx->encode_stats is set (see tools/bandwidth.c)
+struct encode_stats_t {
+    unsigned long unit_bytes[UCHAR_MAX + 1];
+    unsigned long command_bytes[ENCODE_STATS_COMMAND_COUNT];
+    unsigned long command_count[ENCODE_STATS_COMMAND_COUNT];
+};
+
+extern const char *ENCODE_STATS_COMMAND_NAMES[ENCODE_STATS_COMMAND_COUNT];
+
+unsigned char *encode_buffer_write_index(struct libreorama_ctx *ctx);
+
+int encode_buffer_advance(struct libreorama_ctx *ctx,
+                          size_t len);
+
+void encode_buffer_reset(struct libreorama_ctx *ctx);
+
+int encode_frame(struct libreorama_ctx *ctx,
+                 lor_unit_t unit,
                  enum lor_channel_type_t channel_type,
                  lor_channel_t channel,
+                 unsigned char channel_bank,
                  struct frame_t frame);
 
-int encode_heartbeat_frame(frame_index_t frame_index,
+int encode_frame_curve(struct libreorama_ctx *ctx,
+                       lor_unit_t unit,
+                       enum brightness_curve_t curve,
+                       enum lor_channel_type_t channel_type,
+                       lor_channel_t channel,
+                       unsigned char channel_bank,
+                       struct frame_t frame);
+
+// returns the number of bytes #encode_frame_curve would write, or 0 if the action is unsupported
+size_t encode_frame_length(lor_unit_t unit,
+                           enum brightness_curve_t curve,
+                           enum lor_channel_type_t channel_type,
+                           lor_channel_t channel,
+                           unsigned char channel_bank,
+                           struct frame_t frame);
+
+size_t encode_unit_off_frame_length(lor_unit_t unit);
+
+int encode_heartbeat_frame(struct libreorama_ctx *ctx,
+                           frame_index_t frame_index,
                            unsigned short step_time_ms);
 
-int encode_reset_frame();
+int encode_reset_frame(struct libreorama_ctx *ctx);
+
+int encode_unit_off_frame(struct libreorama_ctx *ctx,
+                          lor_unit_t unit);
 
 #endif //LIBREORAMA_ENCODE_H
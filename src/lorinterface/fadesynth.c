@@ -0,0 +1,204 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "fadesynth.h"
+
+#include <limits.h>
+
+#include "../ctx.h"
+
+static bool fadesynth_brightness(struct frame_t frame,
+                                 unsigned char *brightness) {
+    switch (frame.action) {
+        case LOR_ACTION_CHANNEL_SET_BRIGHTNESS:
+            *brightness = frame.set_brightness;
+            return true;
+        case LOR_ACTION_CHANNEL_ON:
+            *brightness = UCHAR_MAX;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// frames are read through the ctx palette each time, since interning a fade may reallocate it
+static struct frame_t fadesynth_frame(const struct libreorama_ctx *ctx,
+                                      const frame_palette_index_t *frames,
+                                      unsigned long frame_index) {
+    return ctx->frame_palette[frames[frame_index]];
+}
+
+static unsigned long fadesynth_next_set(const frame_palette_index_t *frames,
+                                        unsigned long frame_index,
+                                        frame_index_t frame_count) {
+    while (frame_index < frame_count && frames[frame_index] == FRAME_PALETTE_UNSET) {
+        frame_index++;
+    }
+
+    return frame_index;
+}
+
+// tests if every sample between start and end is within FADESYNTH_TOLERANCE of a linear fade
+static bool fadesynth_is_linear(const struct libreorama_ctx *ctx,
+                                const frame_palette_index_t *frames,
+                                unsigned long start,
+                                unsigned long end,
+                                unsigned long spacing,
+                                unsigned char from,
+                                unsigned char to) {
+    for (unsigned long i = start + spacing; i < end; i += spacing) {
+        // every sample has already been tested as a brightness frame by #fadesynth_frames
+        unsigned char brightness = 0;
+
+        fadesynth_brightness(fadesynth_frame(ctx, frames, i), &brightness);
+
+        const long expected = from + ((long) to - from) * (long) (i - start) / (long) (end - start);
+        const long diff     = brightness - expected;
+
+        if (diff > FADESYNTH_TOLERANCE || diff < -FADESYNTH_TOLERANCE) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int fadesynth_frames(struct libreorama_ctx *ctx,
+                     frame_palette_index_t *frames,
+                     struct sequence_t sequence,
+                     unsigned long *fade_count) {
+    unsigned long start = fadesynth_next_set(frames, 0, sequence.frame_count);
+
+    while (start < sequence.frame_count) {
+        const unsigned long next = fadesynth_next_set(frames, start + 1, sequence.frame_count);
+
+        unsigned char from;
+        unsigned char to;
+
+        // a ramp begins with two brightness frames of differing values
+        if (next >= sequence.frame_count || !fadesynth_brightness(fadesynth_frame(ctx, frames, start), &from) || !fadesynth_brightness(fadesynth_frame(ctx, frames, next), &to) || from == to) {
+            start = next;
+            continue;
+        }
+
+        const unsigned long spacing = next - start;
+        const bool          rising  = to > from;
+
+        unsigned long end     = next;
+        unsigned long samples = 2;
+
+        // extend the ramp while each following brightness frame is evenly spaced, moves in the same direction
+        //  and remains on the same linear fade
+        while (true) {
+            const unsigned long candidate = end + spacing;
+
+            if (candidate >= sequence.frame_count || fadesynth_next_set(frames, end + 1, sequence.frame_count) != candidate) {
+                break;
+            }
+
+            unsigned char brightness;
+
+            if (!fadesynth_brightness(fadesynth_frame(ctx, frames, candidate), &brightness) || (rising ? brightness <= to : brightness >= to)) {
+                break;
+            }
+
+            if ((candidate - start) * sequence.step_time_ms / 10 > FADESYNTH_MAX_DURATION_CS || !fadesynth_is_linear(ctx, frames, start, candidate, spacing, from, brightness)) {
+                break;
+            }
+
+            end = candidate;
+            to  = brightness;
+            samples++;
+        }
+
+        if (samples < FADESYNTH_MIN_SAMPLES) {
+            start = next;
+            continue;
+        }
+
+        // the fade reaches its final brightness at the time of the last sample
+        // the remaining samples are cleared since the channel holds the fade's final brightness
+        const struct frame_t fade = (struct frame_t) {
+                .action = LOR_ACTION_CHANNEL_FADE,
+                .fade = {
+                        .from = from,
+                        .to = to,
+                        .duration_cs = (unsigned short) ((end - start) * sequence.step_time_ms / 10),
+                },
+        };
+
+        int err;
+
+        if ((err = frame_palette_intern(ctx, fade, &frames[start]))) {
+            return err;
+        }
+
+        for (unsigned long i = start + spacing; i <= end; i += spacing) {
+            frames[i] = FRAME_PALETTE_UNSET;
+        }
+
+        (*fade_count)++;
+
+        start = fadesynth_next_set(frames, end + 1, sequence.frame_count);
+    }
+
+    return 0;
+}
+
+int fadesynth_sequence(struct libreorama_ctx *ctx,
+                       struct sequence_t sequence,
+                       unsigned long *fade_count) {
+    *fade_count = 0;
+
+    for (size_t i = 0; i < ctx->channel_buffer_index; i++) {
+        struct timeline_t *timeline = &ctx->channel_buffer[i].timeline;
+
+        // each set frame begins a run, so shorter timelines cannot contain a ramp
+        if (!timeline->dense && timeline->length < FADESYNTH_MIN_SAMPLES) {
+            continue;
+        }
+
+        // each timeline is decoded into the scratch frames, and only stored again if a fade was synthesized
+        // a fade replaces several set frames, so the timeline is always rewritten within its existing storage
+        frame_palette_index_t *frames;
+
+        int err;
+        if ((err = frame_buffer_scratch(ctx, sequence.frame_count, &frames))) {
+            return err;
+        }
+
+        timeline_decode(timeline, frames, sequence.frame_count);
+
+        const unsigned long previous_fade_count = *fade_count;
+
+        if ((err = fadesynth_frames(ctx, frames, sequence, fade_count))) {
+            return err;
+        }
+
+        if (*fade_count != previous_fade_count && (err = timeline_store(ctx, timeline, frames, sequence.frame_count))) {
+            return err;
+        }
+    }
+
+    return 0;
+}
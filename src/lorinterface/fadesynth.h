@@ -0,0 +1,51 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LIBREORAMA_FADESYNTH_H
+#define LIBREORAMA_FADESYNTH_H
+
+#include "frame.h"
+#include "../player/sequence.h"
+
+// ramps of at least FADESYNTH_MIN_SAMPLES evenly spaced brightness frames are rewritten into a single fade
+#define FADESYNTH_MIN_SAMPLES 3
+
+// the maximum difference (of 255) between each ramp sample and the synthesized fade at the same time
+// this absorbs the rounding of LMS 0-100 intensities
+#define FADESYNTH_TOLERANCE 6
+
+// synthesized fades are capped in length, longer ramps are split into multiple fades
+#define FADESYNTH_MAX_DURATION_CS 2500
+
+// rewrites the ramps of a single channel's sequence.frame_count dense frames
+// ramps are only found within frames, a window synthesizes each of its segments independently (see window.h)
+int fadesynth_frames(struct libreorama_ctx *ctx,
+                     frame_palette_index_t *frames,
+                     struct sequence_t sequence,
+                     unsigned long *fade_count);
+
+int fadesynth_sequence(struct libreorama_ctx *ctx,
+                       struct sequence_t sequence,
+                       unsigned long *fade_count);
+
+#endif //LIBREORAMA_FADESYNTH_H
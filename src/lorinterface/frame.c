@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../ctx.h"
 #include "../err/lbr.h"
 
 const struct frame_t ZERO_FRAME;
@@ -37,35 +38,283 @@ bool frame_is_set(struct frame_t frame) {
     return frame.action > ZERO_FRAME.action;
 }
 
-static struct frame_t *frame_buffer = NULL;
-static size_t         frame_buffer_count;
+static struct frame_t frame_palette_canonical(struct frame_t frame) {
+    // only the fields used by the frame's action are kept
+    // this ensures frames of equal value are interned as a single palette entry
+    switch (frame.action) {
+        case LOR_ACTION_CHANNEL_SET_BRIGHTNESS:
+            return (struct frame_t) {
+                    .action = frame.action,
+                    .set_brightness = frame.set_brightness,
+            };
+        case LOR_ACTION_CHANNEL_FADE:
+            return (struct frame_t) {
+                    .action = frame.action,
+                    .fade = frame.fade,
+            };
+        default:
+            if (!frame_is_set(frame)) {
+                return ZERO_FRAME;
+            }
 
-int frame_buffer_request(frame_index_t count,
-                         struct frame_t **frames) {
-    frame_buffer = realloc(frame_buffer, sizeof(struct frame_t) * (frame_buffer_count + count));
+            return (struct frame_t) {
+                    .action = frame.action,
+            };
+    }
+}
+
+static uint64_t frame_palette_key(struct frame_t frame) {
+    // keys are built from the fields used by the action, the unused bytes of the union are never read
+    uint64_t key = frame.action;
+
+    switch (frame.action) {
+        case LOR_ACTION_CHANNEL_SET_BRIGHTNESS:
+            key |= (uint64_t) frame.set_brightness << 8u;
+            break;
+        case LOR_ACTION_CHANNEL_FADE:
+            key |= (uint64_t) frame.fade.from << 8u | (uint64_t) frame.fade.to << 16u | (uint64_t) frame.fade.duration_cs << 24u;
+            break;
+        default:
+            break;
+    }
+
+    return key;
+}
+
+static size_t frame_palette_slot(uint64_t key,
+                                 size_t slot_count) {
+    // fibonacci hashing spreads the few low bytes of a frame across every slot
+    return (size_t) ((key * UINT64_C(11400714819323198485)) >> 32u) & (slot_count - 1);
+}
+
+static int frame_palette_grow(struct libreorama_ctx *ctx) {
+    // the palette is open addressed & kept at most half full, slot_count is always a power of 2
+    const size_t slot_count = ctx->frame_palette_slot_count > 0 ? ctx->frame_palette_slot_count * 2 : FRAME_PALETTE_MIN_SLOT_COUNT;
+
+    frame_palette_index_t *slots = calloc(slot_count, sizeof(frame_palette_index_t));
+
+    if (slots == NULL) {
+        return LBR_EERRNO;
+    }
+
+    // FRAME_PALETTE_UNSET is never hashed, so a zeroed slot is empty
+    for (size_t i = FRAME_PALETTE_UNSET + 1; i < ctx->frame_palette_count; i++) {
+        size_t slot = frame_palette_slot(frame_palette_key(ctx->frame_palette[i]), slot_count);
+
+        while (slots[slot] != FRAME_PALETTE_UNSET) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+
+        slots[slot] = (frame_palette_index_t) i;
+    }
+
+    free(ctx->frame_palette_slots);
+
+    ctx->frame_palette_slots      = slots;
+    ctx->frame_palette_slot_count = slot_count;
+
+    return 0;
+}
+
+static int frame_palette_ensure(struct libreorama_ctx *ctx) {
+    if (ctx->frame_palette != NULL) {
+        return 0;
+    }
+
+    ctx->frame_palette = malloc(sizeof(struct frame_t) * FRAME_PALETTE_MIN_SLOT_COUNT);
+
+    if (ctx->frame_palette == NULL) {
+        return LBR_EERRNO;
+    }
+
+    ctx->frame_palette[FRAME_PALETTE_UNSET] = ZERO_FRAME;
+    ctx->frame_palette_count    = FRAME_PALETTE_UNSET + 1;
+    ctx->frame_palette_capacity = FRAME_PALETTE_MIN_SLOT_COUNT;
+
+    return frame_palette_grow(ctx);
+}
+
+int frame_palette_intern(struct libreorama_ctx *ctx,
+                         struct frame_t frame,
+                         frame_palette_index_t *index) {
+    frame = frame_palette_canonical(frame);
+
+    if (!frame_is_set(frame)) {
+        *index = FRAME_PALETTE_UNSET;
+        return 0;
+    }
+
+    int err;
+    if ((err = frame_palette_ensure(ctx))) {
+        return err;
+    }
+
+    const uint64_t key = frame_palette_key(frame);
+
+    size_t slot = frame_palette_slot(key, ctx->frame_palette_slot_count);
+
+    while (ctx->frame_palette_slots[slot] != FRAME_PALETTE_UNSET) {
+        if (frame_palette_key(ctx->frame_palette[ctx->frame_palette_slots[slot]]) == key) {
+            *index = ctx->frame_palette_slots[slot];
+            return 0;
+        }
+
+        slot = (slot + 1) & (ctx->frame_palette_slot_count - 1);
+    }
+
+    if (ctx->frame_palette_count >= FRAME_PALETTE_MAX_COUNT) {
+        return LBR_FRAME_EPALETTEFULL;
+    }
+
+    if (ctx->frame_palette_count == ctx->frame_palette_capacity) {
+        struct frame_t *palette = realloc(ctx->frame_palette, sizeof(struct frame_t) * ctx->frame_palette_capacity * 2);
+
+        if (palette == NULL) {
+            return LBR_EERRNO;
+        }
+
+        ctx->frame_palette          = palette;
+        ctx->frame_palette_capacity = ctx->frame_palette_capacity * 2;
+    }
+
+    *index = (frame_palette_index_t) ctx->frame_palette_count;
 
-    if (frame_buffer == NULL) {
+    ctx->frame_palette[ctx->frame_palette_count++] = frame;
+    ctx->frame_palette_slots[slot]                 = *index;
+
+    if (ctx->frame_palette_count * 2 > ctx->frame_palette_slot_count) {
+        return frame_palette_grow(ctx);
+    }
+
+    return 0;
+}
+
+int frame_palette_reserve(struct libreorama_ctx *ctx,
+                          size_t count) {
+    int err;
+    if ((err = frame_palette_ensure(ctx))) {
+        return err;
+    }
+
+    if (ctx->frame_palette_capacity >= count) {
+        return 0;
+    }
+
+    struct frame_t *palette = realloc(ctx->frame_palette, sizeof(struct frame_t) * count);
+
+    if (palette == NULL) {
         return LBR_EERRNO;
     }
 
-    // initialize the allocated portion of the memory to be returned
-    // this ensures the returned frame pointers are always safe
-    memset(&frame_buffer[frame_buffer_count], 0, sizeof(struct frame_t) * count);
+    ctx->frame_palette          = palette;
+    ctx->frame_palette_capacity = count;
 
-    // checkout a portion of the full buffer
-    *frames = &frame_buffer[frame_buffer_count];
-    frame_buffer_count += count;
+    return 0;
+}
+
+int frame_buffer_reserve(struct libreorama_ctx *ctx,
+                         size_t count) {
+    const struct frame_block_t *current = ctx->frame_blocks;
+
+    // the current block may already fit the reservation
+    if (current != NULL && current->capacity - current->count >= count) {
+        return 0;
+    }
+
+    // every stored frame is resolved through the palette, so it always holds the unset frame
+    int err;
+    if ((err = frame_palette_ensure(ctx))) {
+        return err;
+    }
+
+    // calloc ensures all words are zero initialized, and thereby FRAME_PALETTE_UNSET
+    struct frame_block_t *block = calloc(1, sizeof(struct frame_block_t) + sizeof(frame_word_t) * count);
+
+    if (block == NULL) {
+        return LBR_EERRNO;
+    }
+
+    block->capacity = count;
+
+    // the newest block is always the head, earlier blocks are only retained to be freed
+    block->next       = ctx->frame_blocks;
+    ctx->frame_blocks = block;
 
     return 0;
 }
 
-void frame_buffer_free() {
-    if (frame_buffer != NULL) {
-        free(frame_buffer);
+int frame_buffer_request(struct libreorama_ctx *ctx,
+                         size_t count,
+                         frame_word_t **words) {
+    // blocks begin suitably aligned, rounding each request keeps the following request aligned
+    count = (count + FRAME_BLOCK_REQUEST_ALIGNMENT - 1) / FRAME_BLOCK_REQUEST_ALIGNMENT * FRAME_BLOCK_REQUEST_ALIGNMENT;
+
+    const struct frame_block_t *current = ctx->frame_blocks;
 
-        // release any dangling pointers and avoid double free
-        frame_buffer = NULL;
+    if (current == NULL || current->capacity - current->count < count) {
+        int err;
+        if ((err = frame_buffer_reserve(ctx, count > FRAME_BLOCK_MIN_COUNT ? count : FRAME_BLOCK_MIN_COUNT))) {
+            return err;
+        }
     }
 
-    frame_buffer_count = 0;
+    struct frame_block_t *block = ctx->frame_blocks;
+
+    // checkout a portion of the current block
+    *words = &block->words[block->count];
+    block->count += count;
+
+    return 0;
+}
+
+int frame_buffer_scratch(struct libreorama_ctx *ctx,
+                         frame_index_t count,
+                         frame_palette_index_t **frames) {
+    if (ctx->frame_scratch == NULL || ctx->frame_scratch_count < count) {
+        free(ctx->frame_scratch);
+
+        ctx->frame_scratch_count = 0;
+        ctx->frame_scratch       = malloc(sizeof(frame_palette_index_t) * count);
+
+        if (ctx->frame_scratch == NULL) {
+            return LBR_EERRNO;
+        }
+
+        ctx->frame_scratch_count = count;
+    }
+
+    memset(ctx->frame_scratch, 0, sizeof(frame_palette_index_t) * count);
+
+    *frames = ctx->frame_scratch;
+
+    return 0;
+}
+
+void frame_buffer_free(struct libreorama_ctx *ctx) {
+    struct frame_block_t *block = ctx->frame_blocks;
+
+    while (block != NULL) {
+        struct frame_block_t *next = block->next;
+
+        free(block);
+
+        block = next;
+    }
+
+    // release any dangling pointers and avoid double free
+    ctx->frame_blocks = NULL;
+
+    free(ctx->frame_scratch);
+
+    ctx->frame_scratch       = NULL;
+    ctx->frame_scratch_count = 0;
+
+    free(ctx->frame_palette);
+    free(ctx->frame_palette_slots);
+
+    ctx->frame_palette            = NULL;
+    ctx->frame_palette_count      = 0;
+    ctx->frame_palette_capacity   = 0;
+    ctx->frame_palette_slots      = NULL;
+    ctx->frame_palette_slot_count = 0;
 }
@@ -26,6 +26,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "effect.h"
 
@@ -41,11 +42,71 @@ extern const struct frame_t ZERO_FRAME;
 
 bool frame_is_set(struct frame_t frame);
 
-typedef unsigned short frame_index_t;
+// frame indexes are 32 bits wide, a 10ms step time is only limited after ~497 days
+// sequences exceeding this are rejected when loaded (see LBR_SEQUENCE_ETOOLONG)
+typedef uint32_t frame_index_t;
 
-int frame_buffer_request(frame_index_t count,
-                         struct frame_t **frames);
+#define FRAME_INDEX_MAX UINT32_MAX
 
-void frame_buffer_free();
+// sequences only use a few hundred distinct frames, so each channel's frames are stored as
+//  indexes into a per context palette of unique frames (see #frame_palette_intern)
+// palette frames are canonical (unused fields are zeroed), so equal indexes are equal frame values
+// FRAME_PALETTE_UNSET is always the unset ZERO_FRAME, which allows zero initialized frames to be unset
+// FRAME_PALETTE_NONE marks frames which were never interned, such as those merged by a compositor
+// indexes are 32 bits wide, timelines store them in a single 2 byte word while they fit (see timeline.h)
+typedef uint32_t frame_palette_index_t;
+
+#define FRAME_PALETTE_UNSET          0
+#define FRAME_PALETTE_NONE           UINT32_MAX
+#define FRAME_PALETTE_MAX_COUNT      UINT32_MAX
+#define FRAME_PALETTE_NARROW_MAX     UINT16_MAX
+#define FRAME_PALETTE_MIN_SLOT_COUNT 1024
+
+// frame storage is allocated in 2 byte words, which hold a single index up to FRAME_PALETTE_NARROW_MAX
+typedef uint16_t frame_word_t;
+
+// words are allocated from a sequence scoped arena of zero initialized blocks
+// blocks are never moved or resized, so storage pointers remain valid until #frame_buffer_free
+// requests which do not fit within the current block allocate a new block of at least FRAME_BLOCK_MIN_COUNT words
+// each request is rounded to FRAME_BLOCK_REQUEST_ALIGNMENT words, so that storage may hold 4 byte indexes
+#define FRAME_BLOCK_MIN_COUNT         4096
+#define FRAME_BLOCK_REQUEST_ALIGNMENT (sizeof(frame_palette_index_t) / sizeof(frame_word_t))
+
+struct frame_block_t {
+    struct frame_block_t *next;
+    size_t               capacity;
+    size_t               count;
+    frame_word_t         words[];
+};
+
+struct libreorama_ctx;
+
+// returns the palette index of frame, adding it to the palette if needed
+// unset frames are always FRAME_PALETTE_UNSET, the palette may only grow while loading
+int frame_palette_intern(struct libreorama_ctx *ctx,
+                         struct frame_t frame,
+                         frame_palette_index_t *index);
+
+// allocates the palette for count frames, so that its frames are not moved by #frame_palette_intern until it exceeds count
+// this allows a single thread to intern frames while others read previously interned frames (see window.h)
+int frame_palette_reserve(struct libreorama_ctx *ctx,
+                          size_t count);
+
+// allocates a block for at least count words, so that the next requests totalling count are allocation free
+// loaders call this once the size of a sequence's timelines can be estimated (see timeline.h)
+int frame_buffer_reserve(struct libreorama_ctx *ctx,
+                         size_t count);
+
+int frame_buffer_request(struct libreorama_ctx *ctx,
+                         size_t count,
+                         frame_word_t **words);
+
+// returns a zeroed buffer of count frames, which loaders decode & encode each timeline through (see timeline.h)
+// the buffer is owned by the ctx and reused by each call, so only a single channel's frames are ever dense
+int frame_buffer_scratch(struct libreorama_ctx *ctx,
+                         frame_index_t count,
+                         frame_palette_index_t **frames);
+
+void frame_buffer_free(struct libreorama_ctx *ctx);
 
 #endif //LIBREORAMA_FRAME_H
@@ -0,0 +1,165 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "keyframe.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../ctx.h"
+#include "../err/lbr.h"
+
+int keyframe_index_build(struct libreorama_ctx *ctx,
+                         struct sequence_t sequence) {
+    keyframe_index_free(ctx);
+
+    // keyframe k holds the state of each channel prior to frame k * KEYFRAME_INTERVAL_FRAMES
+    // keyframes are stored keyframe-major so that a restore reads a single contiguous block
+    ctx->keyframe_count = (sequence.frame_count / KEYFRAME_INTERVAL_FRAMES) + 1;
+    ctx->keyframe_index = malloc(sizeof(struct keyframe_state_t) * ctx->keyframe_count * ctx->channel_buffer_index);
+
+    if (ctx->keyframe_index == NULL) {
+        ctx->keyframe_count = 0;
+        return LBR_EERRNO;
+    }
+
+    for (size_t i = 0; i < ctx->channel_buffer_index; i++) {
+        struct timeline_t       *timeline = &ctx->channel_buffer[i].timeline;
+        struct keyframe_state_t state     = (struct keyframe_state_t) {
+                .frame = ZERO_FRAME,
+        };
+
+        // the timeline is read from its first frame, restarting its cursor
+        for (size_t frame_index = 0; frame_index < sequence.frame_count; frame_index++) {
+            const frame_palette_index_t palette_index = timeline_read(timeline, (frame_index_t) frame_index);
+
+            // the cursor already addresses frame_index, it is recorded before its frame is applied
+            if (frame_index % KEYFRAME_INTERVAL_FRAMES == 0) {
+                state.cursor = timeline->cursor;
+
+                ctx->keyframe_index[(frame_index / KEYFRAME_INTERVAL_FRAMES) * ctx->channel_buffer_index + i] = state;
+            }
+
+            // frames are only set when an effect starts
+            // the most recently started effect remains the channel's active state
+            if (palette_index != FRAME_PALETTE_UNSET) {
+                state.frame       = ctx->frame_palette[palette_index];
+                state.frame_index = (frame_index_t) frame_index;
+            }
+        }
+
+        state.cursor = timeline->cursor;
+
+        // frame_count may be an exact multiple of the interval
+        // ensure the trailing keyframe is always initialized
+        if (sequence.frame_count % KEYFRAME_INTERVAL_FRAMES == 0) {
+            ctx->keyframe_index[(ctx->keyframe_count - 1) * ctx->channel_buffer_index + i] = state;
+        }
+    }
+
+    return 0;
+}
+
+struct frame_t keyframe_sync_frame(struct keyframe_state_t state,
+                                   frame_index_t frame_index,
+                                   unsigned short step_time_ms) {
+    if (state.frame.action != LOR_ACTION_CHANNEL_FADE) {
+        return state.frame;
+    }
+
+    // fades are stateful internally to the hardware
+    // resume from the interpolated brightness with the remaining duration
+    const unsigned long elapsed_cs = ((unsigned long) (frame_index - state.frame_index) * step_time_ms) / 10;
+
+    const struct frame_effect_fade_t fade = state.frame.fade;
+
+    if (elapsed_cs >= fade.duration_cs) {
+        return (struct frame_t) {
+                .action = LOR_ACTION_CHANNEL_SET_BRIGHTNESS,
+                .set_brightness = fade.to,
+        };
+    }
+
+    const long from = fade.from + (((long) fade.to - fade.from) * (long) elapsed_cs) / fade.duration_cs;
+
+    return (struct frame_t) {
+            .action = LOR_ACTION_CHANNEL_FADE,
+            .fade = (struct frame_effect_fade_t) {
+                    .from = (unsigned char) from,
+                    .to = fade.to,
+                    .duration_cs = (unsigned short) (fade.duration_cs - elapsed_cs),
+            },
+    };
+}
+
+int keyframe_restore(struct libreorama_ctx *ctx,
+                     struct sequence_t sequence,
+                     frame_index_t frame_index,
+                     const struct frame_t **frames) {
+    if (ctx->keyframe_index == NULL) {
+        return LBR_SEQUENCE_ENOKEYFRAMES;
+    }
+
+    if (frame_index > sequence.frame_count) {
+        frame_index = sequence.frame_count;
+    }
+
+    // restore the nearest prior keyframe and replay the remaining delta
+    // this is bounded by KEYFRAME_INTERVAL_FRAMES, regardless of sequence length
+    const size_t keyframe = frame_index / KEYFRAME_INTERVAL_FRAMES;
+
+    memcpy(ctx->restore_state_buffer, &ctx->keyframe_index[keyframe * ctx->channel_buffer_index], sizeof(struct keyframe_state_t) * ctx->channel_buffer_index);
+
+    for (size_t i = 0; i < ctx->channel_buffer_index; i++) {
+        struct timeline_t *timeline = &ctx->channel_buffer[i].timeline;
+
+        // resume decoding from the keyframe's cursor, which playback continues from
+        timeline->cursor = ctx->restore_state_buffer[i].cursor;
+
+        for (size_t x = keyframe * KEYFRAME_INTERVAL_FRAMES; x < frame_index; x++) {
+            const frame_palette_index_t palette_index = timeline_read(timeline, (frame_index_t) x);
+
+            if (palette_index != FRAME_PALETTE_UNSET) {
+                ctx->restore_state_buffer[i].frame       = ctx->frame_palette[palette_index];
+                ctx->restore_state_buffer[i].frame_index = (frame_index_t) x;
+            }
+        }
+
+        ctx->restore_frame_buffer[i] = keyframe_sync_frame(ctx->restore_state_buffer[i], frame_index, sequence.step_time_ms);
+    }
+
+    *frames = ctx->restore_frame_buffer;
+
+    return 0;
+}
+
+void keyframe_index_free(struct libreorama_ctx *ctx) {
+    if (ctx->keyframe_index != NULL) {
+        free(ctx->keyframe_index);
+
+        // release any dangling pointers and avoid double free
+        ctx->keyframe_index = NULL;
+    }
+
+    ctx->keyframe_count = 0;
+}
@@ -0,0 +1,58 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LIBREORAMA_KEYFRAME_H
+#define LIBREORAMA_KEYFRAME_H
+
+#include "frame.h"
+#include "timeline.h"
+#include "../player/sequence.h"
+
+// a full per-channel state snapshot is recorded every KEYFRAME_INTERVAL_FRAMES frames
+// seeking replays at most KEYFRAME_INTERVAL_FRAMES - 1 frames past the nearest keyframe
+#define KEYFRAME_INTERVAL_FRAMES 64
+
+struct keyframe_state_t {
+    struct frame_t frame;
+    frame_index_t  frame_index;
+
+    // the channel's timeline cursor prior to the keyframe, so a restore never decodes from the first run
+    struct timeline_cursor_t cursor;
+};
+
+int keyframe_index_build(struct libreorama_ctx *ctx,
+                         struct sequence_t sequence);
+
+// returns the frame which resumes state as of frame_index, fades are resumed part way through
+struct frame_t keyframe_sync_frame(struct keyframe_state_t state,
+                                   frame_index_t frame_index,
+                                   unsigned short step_time_ms);
+
+int keyframe_restore(struct libreorama_ctx *ctx,
+                     struct sequence_t sequence,
+                     frame_index_t frame_index,
+                     const struct frame_t **frames);
+
+void keyframe_index_free(struct libreorama_ctx *ctx);
+
+#endif //LIBREORAMA_KEYFRAME_H
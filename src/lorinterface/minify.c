@@ -23,11 +23,15 @@
  */
 #include "minify.h"
 
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "../ctx.h"
 #include "../err/lbr.h"
+#include "../player/framestats.h"
+#include "brightness.h"
 #include "encode.h"
 #include "state.h"
 
@@ -59,7 +63,7 @@ static bool frame_equals(const struct frame_t a,
                 // they cannot be equal and shouldn't be
                 return false;
             } else if (equals_mode == EQUALS_MODE_VALUE) {
-                return a.fade.duration == b.fade.duration && a.fade.to == b.fade.to && a.fade.from == b.fade.from;
+                return a.fade.duration_cs == b.fade.duration_cs && a.fade.to == b.fade.to && a.fade.from == b.fade.from;
             } else {
                 fprintf(stderr, "unsupported equals_mode: %d\n", equals_mode);
                 return false;
@@ -76,98 +80,221 @@ static bool frame_equals(const struct frame_t a,
     }
 }
 
-static int minify_channel_compare(const void *a,
-                                  const void *b) {
-    const struct channel_t *channel_a = (struct channel_t *) a;
-    const struct channel_t *channel_b = (struct channel_t *) b;
+// palette frames are canonical, so frames which were both interned compare by palette index alone
+// frames which were not interned, such as compositor merged or keyframe restored frames, are compared by value
+static bool minify_frame_equals(struct frame_t a,
+                                frame_palette_index_t a_palette,
+                                struct frame_t b,
+                                frame_palette_index_t b_palette,
+                                enum frame_equals_mode_t equals_mode) {
+    if (a_palette != FRAME_PALETTE_NONE && b_palette != FRAME_PALETTE_NONE) {
+        // fades are never strictly equal, see #frame_equals
+        return a_palette == b_palette && (equals_mode != EQUALS_MODE_STRICT || a.action != LOR_ACTION_CHANNEL_FADE);
+    }
+
+    return frame_equals(a, b, equals_mode);
+}
+
+static bool minify_frame_brightness(struct frame_t frame,
+                                    unsigned char *brightness) {
+    switch (frame.action) {
+        case LOR_ACTION_CHANNEL_SET_BRIGHTNESS:
+            *brightness = frame.set_brightness;
+            return true;
+        case LOR_ACTION_CHANNEL_ON:
+            *brightness = UCHAR_MAX;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// tests if two brightness frames are within ctx->minify_tolerance steps of each other, as encoded by the unit's curve
+static bool minify_within_tolerance(const struct libreorama_ctx *ctx,
+                                    lor_unit_t unit,
+                                    struct frame_t a,
+                                    struct frame_t b) {
+    unsigned char a_brightness;
+    unsigned char b_brightness;
+
+    if (ctx->minify_tolerance == 0 || !minify_frame_brightness(a, &a_brightness) || !minify_frame_brightness(b, &b_brightness)) {
+        return false;
+    }
+
+    const lor_brightness_t *curve = BRIGHTNESS_CURVE_TABLES[ctx->unit_brightness_curve[unit]];
+    const int              diff   = curve[a_brightness] - curve[b_brightness];
+
+    return diff <= ctx->minify_tolerance && diff >= -ctx->minify_tolerance;
+}
+
+static void minify_push_command(struct libreorama_ctx *ctx,
+                                lor_unit_t unit,
+                                const struct channel_t *channels,
+                                size_t len,
+                                LORChannelType channel_type,
+                                lor_channel_t channel,
+                                unsigned char channel_bank,
+                                struct frame_t frame,
+                                bool unit_off) {
+    // commands never outnumber the channels, since each consumes at least one pending frame
+    ctx->command_buffer[ctx->command_buffer_index++] = (struct minify_command_t) {
+            .unit = unit,
+            .channel_type = channel_type,
+            .channel = channel,
+            .channel_bank = channel_bank,
+            .frame = frame,
+            .unit_off = unit_off,
+            .channel_start = (size_t) (channels - ctx->channel_buffer),
+            .channel_len = len,
+    };
+}
 
-    if (channel_a->unit != channel_b->unit) {
-        return channel_a->unit - channel_b->unit;
+static bool minify_frame_is_dark(struct frame_t frame) {
+    // unset frames have never been sent since the last reset, which turns off all units
+    return !frame_is_set(frame) || (frame.action == LOR_ACTION_CHANNEL_SET_BRIGHTNESS && frame.set_brightness == 0);
+}
+
+// tests if every circuit of the unit is dark once its pending frames are sent
+// the unit's circuits are those loaded into the ctx for this unit
+static bool minify_unit_is_dark(const struct channel_output_state_t *states,
+                                size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (!minify_frame_is_dark(states[i].last_sent_frame)) {
+            return false;
+        }
     }
 
-    return channel_a->circuit - channel_b->circuit;
+    return true;
 }
 
-static int minify_write_frames_unoptimized(struct channel_t *channels,
-                                           size_t len) {
+static void minify_write_unit_off(struct libreorama_ctx *ctx,
+                                  lor_unit_t unit,
+                                  const struct channel_t *channels,
+                                  struct channel_output_state_t *states,
+                                  size_t len) {
+    // a single unit action replaces the channel commands of every pending frame
+    for (size_t i = 0; i < len; i++) {
+        states[i].pending_send_frame   = ZERO_FRAME;
+        states[i].pending_send_palette = FRAME_PALETTE_UNSET;
+    }
+
+    minify_push_command(ctx, unit, channels, len, LOR_CHANNEL_ID, 0, 0, ZERO_FRAME, true);
+}
+
+static void minify_write_frames_unoptimized(struct libreorama_ctx *ctx,
+                                            lor_unit_t unit,
+                                            const struct channel_t *channels,
+                                            struct channel_output_state_t *states,
+                                            size_t len) {
     for (size_t i = 0; i < len; i++) {
         const struct channel_t        channel = channels[i];
-        struct channel_output_state_t *state  = &output_state[i];
+        struct channel_output_state_t *state  = &states[i];
 
         if (frame_is_set(state->pending_send_frame)) {
-            int err;
-            if ((err = encode_frame(channel.unit, LOR_CHANNEL_ID, channel.circuit, state->pending_send_frame))) {
-                return err;
-            }
+            minify_push_command(ctx, unit, channels, len, LOR_CHANNEL_ID, channel.circuit, 0, state->pending_send_frame, false);
 
             // null the current frame
             // this ensures each frame is consumed
-            state->pending_send_frame = ZERO_FRAME;
+            state->pending_send_frame   = ZERO_FRAME;
+            state->pending_send_palette = FRAME_PALETTE_UNSET;
         }
     }
+}
 
-    return 0;
+// selects the cheapest addressing for a channel mask within *channel_bank
+static void minify_address_mask(LORChannelType *channel_type,
+                                lor_channel_t *channel,
+                                unsigned char *channel_bank,
+                                lor_channel_t channel_mask) {
+    // a lone circuit outside of the first bank is cheaper as a LOR_CHANNEL_ID
+    // since it avoids writing the bank index
+    if (*channel_bank > 0 && (channel_mask & (channel_mask - 1)) == 0) {
+        lor_channel_t circuit = (lor_channel_t) (*channel_bank * ENCODE_CHANNEL_BANK_SIZE);
+
+        // shift a copy, channel_mask is still needed when the circuit exceeds ENCODE_CHANNEL_ID_MAX
+        for (lor_channel_t bit = channel_mask; !(bit & 1u); bit >>= 1u) {
+            circuit++;
+        }
+
+        if (circuit <= ENCODE_CHANNEL_ID_MAX) {
+            *channel_type = LOR_CHANNEL_ID;
+            *channel      = circuit;
+            *channel_bank = 0;
+            return;
+        }
+    }
+
+    // if channel_mask can fit within an 8 bit mask, encode is as a LOR_CHANNEL_MASK8
+    // this prevents writing the empty upper byte and saves bandwidth
+    *channel_type = channel_mask <= UINT8_MAX ? LOR_CHANNEL_MASK8 : LOR_CHANNEL_MASK16;
+    *channel      = channel_mask;
 }
 
-static int minify_write_frames_optimized(lor_unit_t unit,
-                                         struct channel_t *channels,
-                                         size_t len) {
+static void minify_write_frames_optimized(struct libreorama_ctx *ctx,
+                                          lor_unit_t unit,
+                                          const struct channel_t *channels,
+                                          struct channel_output_state_t *states,
+                                          size_t len) {
     // iterate over each next frame
     // ensure it has not already been processed
     // then, find all channels using a copy of that frame
     // use each channel to set a bitmask
     for (size_t i = 0; i < len; i++) {
-        struct channel_output_state_t *base_state = &output_state[i];
+        struct channel_output_state_t *base_state = &states[i];
 
         if (!frame_is_set(base_state->pending_send_frame)) {
             continue;
         }
 
-        const struct frame_t base_frame_copy = base_state->pending_send_frame;
+        const struct frame_t        base_frame_copy = base_state->pending_send_frame;
+        const frame_palette_index_t base_palette    = base_state->pending_send_palette;
+        const unsigned char         channel_bank    = ENCODE_CHANNEL_BANK_OF(channels[i].circuit);
 
         lor_channel_t channel_mask = 0;
 
-        // find all similar values of this frame
+        // find all similar values of this frame within the same bank
         // null their frames_diff entry since the channel will be set in the mask
-        for (size_t x = 0; x < len; x++) {
+        // channels are sorted by circuit, so any earlier channel of this bank has already been consumed
+        for (size_t x = i; x < len; x++) {
             const struct channel_t        other_channel = channels[x];
-            struct channel_output_state_t *other_state  = &output_state[x];
+            struct channel_output_state_t *other_state  = &states[x];
 
-            if (frame_equals(base_state->pending_send_frame, other_state->pending_send_frame, EQUALS_MODE_VALUE)) {
-                // set the channel's circuit in the bitmask
-                channel_mask |= (1u << other_channel.circuit);
+            if (ENCODE_CHANNEL_BANK_OF(other_channel.circuit) != channel_bank) {
+                break;
+            }
+
+            if (minify_frame_equals(base_frame_copy, base_palette, other_state->pending_send_frame, other_state->pending_send_palette, EQUALS_MODE_VALUE)) {
+                // set the channel's circuit in the bitmask, relative to its bank
+                channel_mask |= (1u << (other_channel.circuit % ENCODE_CHANNEL_BANK_SIZE));
 
                 // this channel no longer needs to write its frame individually
                 // it has been merged into the current channel_mask
                 // this is what ultimately consumes each next_frame value
-                other_state->pending_send_frame = ZERO_FRAME;
+                other_state->pending_send_frame   = ZERO_FRAME;
+                other_state->pending_send_palette = FRAME_PALETTE_UNSET;
             }
         }
 
-        // if channel_mask can fit within an 8 bit mask, encode is as a LOR_CHANNEL_MASK8
-        // this prevents writing the empty upper byte and saves bandwidth
-        const LORChannelType channel_type = channel_mask <= UINT8_MAX ? LOR_CHANNEL_MASK8 : LOR_CHANNEL_MASK16;
+        LORChannelType channel_type;
+        lor_channel_t  channel;
+        unsigned char  bank = channel_bank;
 
-        int err;
-        if ((err = encode_frame(unit, channel_type, channel_mask, base_frame_copy))) {
-            return err;
-        }
-    }
+        minify_address_mask(&channel_type, &channel, &bank, channel_mask);
 
-    return 0;
+        minify_push_command(ctx, unit, channels, len, channel_type, channel, bank, base_frame_copy, false);
+    }
 }
 
-static bool minify_channels_fit_bitmask(const struct channel_t *channels,
+static bool minify_channels_fit_bitmask(const struct libreorama_ctx *ctx,
+                                        const struct channel_t *channels,
                                         size_t len) {
-    static const size_t max_length = sizeof(lor_channel_t) * 8;
-
-    if (len > max_length) {
-        return false;
-    }
+    // without channel banks, masks may only address the first bank (see ENCODE_CHANNEL_BANK_FLAG)
+    // units with circuits beyond it fall back to a command per channel
+    const size_t bank_count = ctx->channel_banks ? UCHAR_MAX + 1 : 1;
 
-    // ensure that each circuit id fits in the bitmask
+    // ensure that each circuit id falls within an addressable bank
     for (size_t i = 0; i < len; i++) {
-        if (channels[i].circuit >= max_length) {
+        if (channels[i].circuit / ENCODE_CHANNEL_BANK_SIZE >= bank_count) {
             return false;
         }
     }
@@ -175,9 +302,12 @@ static bool minify_channels_fit_bitmask(const struct channel_t *channels,
     return true;
 }
 
-static int minify_unit(lor_unit_t unit,
-                       struct channel_t *channels,
-                       struct frame_t *upcoming_frames,
+static int minify_unit(struct libreorama_ctx *ctx,
+                       lor_unit_t unit,
+                       const struct channel_t *channels,
+                       struct channel_output_state_t *states,
+                       const struct frame_t *upcoming_frames,
+                       const frame_palette_index_t *upcoming_palettes,
                        size_t len) {
     int return_code = 0;
 
@@ -185,17 +315,50 @@ static int minify_unit(lor_unit_t unit,
     size_t no_change_count = 0;
 
     for (size_t i = 0; i < len; i++) {
-        struct channel_output_state_t *state         = &output_state[i];
-        struct frame_t                upcoming_frame = upcoming_frames[i];
+        struct channel_output_state_t *state           = &states[i];
+        struct frame_t                upcoming_frame   = upcoming_frames[i];
+        frame_palette_index_t         upcoming_palette = upcoming_palettes[i];
+        bool                          settled          = false;
+
+        // NULL frames are effectively no-op values, the channel holds its last sent frame
+        // unless a suppressed frame has settled, in which case it is sent now
+        if (!frame_is_set(upcoming_frame)) {
+            if (!frame_is_set(state->suppressed_frame) || ++state->suppressed_age < MINIFY_SETTLE_FRAMES) {
+                no_change_count++;
+                continue;
+            }
+
+            upcoming_frame   = state->suppressed_frame;
+            upcoming_palette = state->suppressed_palette;
+            settled          = true;
+        }
 
         // detect matching frames
-        //  include a OR condition for next_frame == NULL, this enables frames switching to NULL value
-        //  from being considered "different" frames when NULL frames are effectively no-op values
-        if (frame_equals(state->last_sent_frame, upcoming_frame, EQUALS_MODE_STRICT) || !frame_is_set(upcoming_frame)) {
+        if (minify_frame_equals(state->last_sent_frame, state->last_sent_palette, upcoming_frame, upcoming_palette, EQUALS_MODE_STRICT)) {
+            state->suppressed_frame   = ZERO_FRAME;
+            state->suppressed_palette = FRAME_PALETTE_UNSET;
+
+            no_change_count++;
+            continue;
+        }
+
+        // small brightness changes are suppressed, leaving last_sent_frame as the accumulated error reference
+        if (!settled && minify_within_tolerance(ctx, unit, state->last_sent_frame, upcoming_frame)) {
+            state->suppressed_frame   = upcoming_frame;
+            state->suppressed_palette = upcoming_palette;
+            state->suppressed_age     = 0;
+
             no_change_count++;
-        } else {
-            state->pending_send_frame = upcoming_frame;
+            continue;
         }
+
+        // last_sent_frame only tracks frames which are actually sent
+        state->pending_send_frame   = upcoming_frame;
+        state->pending_send_palette = upcoming_palette;
+        state->last_sent_frame      = upcoming_frame;
+        state->last_sent_palette    = upcoming_palette;
+        state->suppressed_frame     = ZERO_FRAME;
+        state->suppressed_palette   = FRAME_PALETTE_UNSET;
     }
 
     // no changes between frames, instantly return
@@ -203,91 +366,379 @@ static int minify_unit(lor_unit_t unit,
         goto minify_unit_return;
     }
 
-    const bool fits_in_mask = minify_channels_fit_bitmask(channels, len);
+    const bool fits_in_mask = minify_channels_fit_bitmask(ctx, channels, len);
 
-    if (fits_in_mask) {
-        return_code = minify_write_frames_optimized(unit, channels, len);
+    // last_sent_frame already reflects the pending frames
+    // if the whole unit is going dark, fold all of its commands into a single unit off action
+    if (minify_unit_is_dark(states, len)) {
+        minify_write_unit_off(ctx, unit, channels, states, len);
+    } else if (fits_in_mask) {
+        minify_write_frames_optimized(ctx, unit, channels, states, len);
     } else {
         // this is a fallback handler if the channels do not fit in the max bitmask length
         // this writes each frame individually, unoptimized
         // this is arguably the worst case scenario
-        return_code = minify_write_frames_unoptimized(channels, len);
-    }
-
-    if (return_code) {
-        goto minify_unit_return;
+        minify_write_frames_unoptimized(ctx, unit, channels, states, len);
     }
 
     // ensure all frame differences are null
     // otherwise this indicates failure to consume all frames
     for (size_t i = 0; i < len; i++) {
-        if (frame_is_set(output_state[i].pending_send_frame)) {
+        if (frame_is_set(states[i].pending_send_frame)) {
             return_code = LBR_MINIFY_EUNCONDATA;
             goto minify_unit_return;
         }
     }
 
     minify_unit_return:
-    // mark all channels as non-dirty
-    // update last sent frame value to new frame value
+    return return_code;
+}
+
+static int minify_write_command(struct libreorama_ctx *ctx,
+                                lor_unit_t unit,
+                                const struct minify_command_t *command) {
+    if (command->unit_off) {
+        return encode_unit_off_frame(ctx, unit);
+    }
+
+    return encode_frame_curve(ctx, unit, (enum brightness_curve_t) ctx->unit_brightness_curve[command->unit], command->channel_type, command->channel, command->channel_bank, command->frame);
+}
+
+// encodes each command in ctx->command_buffer, in order, except those flagged in consumed (if provided)
+static int minify_write_commands(struct libreorama_ctx *ctx,
+                                 const bool *consumed) {
+    for (size_t i = 0; i < ctx->command_buffer_index; i++) {
+        if (consumed != NULL && consumed[i]) {
+            continue;
+        }
+
+        int err;
+        if ((err = minify_write_command(ctx, ctx->command_buffer[i].unit, &ctx->command_buffer[i]))) {
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+static bool minify_command_equals(const struct libreorama_ctx *ctx,
+                                  const struct minify_command_t *a,
+                                  const struct minify_command_t *b) {
+    // a broadcast is encoded with a single curve, so each unit must share it
+    if (ctx->unit_brightness_curve[a->unit] != ctx->unit_brightness_curve[b->unit] || a->unit_off != b->unit_off) {
+        return false;
+    }
+
+    return a->unit_off || (a->channel_type == b->channel_type && a->channel == b->channel && a->channel_bank == b->channel_bank && frame_equals(a->frame, b->frame, EQUALS_MODE_VALUE));
+}
+
+// tests if a command, when sent to any unit, would modify the given circuit
+static bool minify_command_affects(const struct minify_command_t *command,
+                                   lor_channel_t circuit) {
+    if (command->unit_off) {
+        return true;
+    } else if (command->channel_type == LOR_CHANNEL_ID) {
+        return circuit == command->channel;
+    }
+
+    return ENCODE_CHANNEL_BANK_OF(circuit) == command->channel_bank && (command->channel & (1u << (circuit % ENCODE_CHANNEL_BANK_SIZE)));
+}
+
+// returns the frame which restores a channel to its last sent state
+// fades are stateful within the hardware and cannot be restored without restarting them
+static bool minify_restore_frame(struct frame_t last_sent_frame,
+                                 struct frame_t *frame) {
+    if (!frame_is_set(last_sent_frame)) {
+        *frame = (struct frame_t) {
+                .action = LOR_ACTION_CHANNEL_SET_BRIGHTNESS,
+                .set_brightness = 0,
+        };
+        return true;
+    } else if (last_sent_frame.action == LOR_ACTION_CHANNEL_FADE) {
+        return false;
+    }
+
+    *frame = last_sent_frame;
+    return true;
+}
+
+static int minify_write_corrections(struct libreorama_ctx *ctx,
+                                    const struct channel_t *channels,
+                                    const struct channel_output_state_t *states,
+                                    bool *correct,
+                                    size_t len) {
+    const bool fits_in_mask = minify_channels_fit_bitmask(ctx, channels, len);
+
     for (size_t i = 0; i < len; i++) {
-        output_state[i].last_sent_frame = upcoming_frames[i];
+        if (!correct[i]) {
+            continue;
+        }
+
+        struct frame_t base_frame;
+
+        minify_restore_frame(states[i].last_sent_frame, &base_frame);
+
+        if (!fits_in_mask) {
+            correct[i] = false;
+
+            int err;
+            if ((err = encode_frame(ctx, channels[i].unit, LOR_CHANNEL_ID, channels[i].circuit, 0, base_frame))) {
+                return err;
+            }
+
+            continue;
+        }
+
+        const unsigned char channel_bank = ENCODE_CHANNEL_BANK_OF(channels[i].circuit);
+
+        lor_channel_t channel_mask = 0;
+
+        for (size_t x = i; x < len && ENCODE_CHANNEL_BANK_OF(channels[x].circuit) == channel_bank; x++) {
+            struct frame_t other_frame;
+
+            if (correct[x] && minify_restore_frame(states[x].last_sent_frame, &other_frame) && frame_equals(base_frame, other_frame, EQUALS_MODE_VALUE)) {
+                channel_mask |= (1u << (channels[x].circuit % ENCODE_CHANNEL_BANK_SIZE));
+                correct[x] = false;
+            }
+        }
+
+        LORChannelType channel_type;
+        lor_channel_t  channel;
+        unsigned char  bank = channel_bank;
+
+        minify_address_mask(&channel_type, &channel, &bank, channel_mask);
+
+        int err;
+        if ((err = encode_frame(ctx, channels[i].unit, channel_type, channel, bank, base_frame))) {
+            return err;
+        }
     }
 
-    return return_code;
+    return 0;
 }
 
-static struct channel_t channel_sort_buffer[CHANNEL_BUFFER_MAX_COUNT];
-static struct frame_t   upcoming_frames_buffer[CHANNEL_BUFFER_MAX_COUNT];
+static int minify_write_commands_broadcast(struct libreorama_ctx *ctx) {
+    // covered channels have a pending command which will be sent after all broadcasts
+    // correct channels are modified by a broadcast meant for other units, and must be restored afterwards
+    // each flag array is a channel_buffer_capacity sized slice of the preallocated scratch (see #channel_buffer_reserve)
+    const size_t capacity = ctx->channel_buffer_capacity;
 
-int minify_frame(struct sequence_t sequence,
-                 frame_index_t frame_index) {
-    // sort channels by unit+circuit in descending order
-    // this allows a iteration loop to easily detect unit "breaks"
-    memcpy(channel_sort_buffer, channel_buffer, sizeof(struct channel_t) * channel_buffer_index);
+    bool *covered   = &ctx->broadcast_dedup_flags[0];
+    bool *correct   = &ctx->broadcast_dedup_flags[capacity];
+    bool *consumed  = &ctx->broadcast_dedup_flags[capacity * 2];
+    bool *broadcast = &ctx->broadcast_dedup_flags[capacity * 3];
+    bool *member    = &ctx->broadcast_dedup_flags[capacity * 4];
+    bool member_unit[UCHAR_MAX + 1];
 
-    qsort(channel_sort_buffer, channel_buffer_index, sizeof(struct channel_t), minify_channel_compare);
+    size_t *new_corrections = ctx->broadcast_dedup_corrections;
 
-    // create an array of the new frame values
-    // this is derived from the sorted channels array so indexes match
-    memset(upcoming_frames_buffer, 0, sizeof(struct frame_t) * channel_buffer_index);
+    const size_t command_count = ctx->command_buffer_index;
 
-    if (frame_index < sequence.frame_count) {
-        for (size_t i = 0; i < channel_buffer_index; i++) {
-            upcoming_frames_buffer[i] = channel_sort_buffer[i].frame_data[frame_index];
+    // member is always assigned before it is read
+    memset(covered, 0, sizeof(bool) * ctx->channel_buffer_index);
+    memset(correct, 0, sizeof(bool) * ctx->channel_buffer_index);
+    memset(consumed, 0, sizeof(bool) * command_count);
+    memset(broadcast, 0, sizeof(bool) * command_count);
+
+    for (size_t i = 0; i < command_count; i++) {
+        const struct minify_command_t *command = &ctx->command_buffer[i];
+
+        for (size_t x = command->channel_start; x < command->channel_start + command->channel_len; x++) {
+            if (minify_command_affects(command, ctx->channel_buffer[x].circuit)) {
+                covered[x] = true;
+            }
         }
     }
 
-    // iterate over channels
-    // each time the unit changes, push that grouping into #minify_unit
-    // start at index 1 to avoid underflowing 0
-    size_t last_break = 0;
+    for (size_t i = 0; i < command_count; i++) {
+        const struct minify_command_t *command = &ctx->command_buffer[i];
+
+        if (consumed[i]) {
+            continue;
+        }
+
+        // find each other unit sending an identical command
+        size_t member_count   = 0;
+        size_t unicast_length = 0;
+
+        memset(member_unit, 0, sizeof(member_unit));
+
+        for (size_t x = i; x < command_count; x++) {
+            member[x] = !consumed[x] && minify_command_equals(ctx, command, &ctx->command_buffer[x]);
 
-    for (size_t i = 1; i < channel_buffer_index; i++) {
-        const struct channel_t last_channel = channel_sort_buffer[i - 1];
+            if (member[x]) {
+                member_unit[ctx->command_buffer[x].unit] = true;
+                member_count++;
+                unicast_length += command->unit_off ? encode_unit_off_frame_length(ctx->command_buffer[x].unit) : encode_frame_length(ctx->command_buffer[x].unit, (enum brightness_curve_t) ctx->unit_brightness_curve[command->unit], command->channel_type, command->channel, command->channel_bank, command->frame);
+            }
+        }
 
-        if (last_channel.unit == channel_sort_buffer[i].unit) {
+        if (member_count < 2) {
             continue;
         }
 
-        int err;
-        if ((err = minify_unit(last_channel.unit, &channel_sort_buffer[last_break], &upcoming_frames_buffer[last_break], i - last_break))) {
+        size_t broadcast_length = command->unit_off ? encode_unit_off_frame_length(LOR_UNIT_ID_BROADCAST) : encode_frame_length(LOR_UNIT_ID_BROADCAST, (enum brightness_curve_t) ctx->unit_brightness_curve[command->unit], command->channel_type, command->channel, command->channel_bank, command->frame);
+        size_t correction_count = 0;
+        bool   safe             = true;
+
+        // every channel outside of the member units that the broadcast modifies must be restored
+        // unless it will be overwritten by its own pending command, or is already due to be restored
+        for (size_t x = 0; x < ctx->channel_buffer_index && safe; x++) {
+            const struct channel_t channel = ctx->channel_buffer[x];
+
+            if (covered[x] || correct[x] || member_unit[channel.unit] || !minify_command_affects(command, channel.circuit)) {
+                continue;
+            }
+
+            struct frame_t restore_frame;
+
+            if (!minify_restore_frame(ctx->output_state[x].last_sent_frame, &restore_frame)) {
+                safe = false;
+                break;
+            }
+
+            broadcast_length += encode_frame_length(channel.unit, (enum brightness_curve_t) ctx->unit_brightness_curve[channel.unit], LOR_CHANNEL_ID, channel.circuit, 0, restore_frame);
+            new_corrections[correction_count++] = x;
+        }
+
+        // corrections are costed as individual commands, though they may later be merged by mask
+        if (!safe || broadcast_length >= unicast_length) {
+            continue;
+        }
+
+        broadcast[i] = true;
+
+        for (size_t x = i; x < command_count; x++) {
+            if (!member[x]) {
+                continue;
+            }
+
+            const struct minify_command_t *member_command = &ctx->command_buffer[x];
+
+            consumed[x] = true;
+
+            // the member's channels are now set by the broadcast, which may be modified by a later broadcast
+            for (size_t y = member_command->channel_start; y < member_command->channel_start + member_command->channel_len; y++) {
+                if (minify_command_affects(member_command, ctx->channel_buffer[y].circuit)) {
+                    covered[y] = false;
+                }
+            }
+        }
+
+        for (size_t x = 0; x < correction_count; x++) {
+            correct[new_corrections[x]] = true;
+        }
+    }
+
+    // broadcasts are written first, followed by per unit commands and corrections
+    // this ensures every channel ends in its intended state regardless of broadcast order
+    int err;
+
+    for (size_t i = 0; i < command_count; i++) {
+        if (broadcast[i] && (err = minify_write_command(ctx, LOR_UNIT_ID_BROADCAST, &ctx->command_buffer[i]))) {
+            return err;
+        }
+    }
+
+    if ((err = minify_write_commands(ctx, consumed))) {
+        return err;
+    }
+
+    // corrections are grouped by unit, which are contiguous in the sorted channel_buffer
+    size_t last_break = 0;
+
+    for (size_t i = 1; i <= ctx->channel_buffer_index; i++) {
+        if (i < ctx->channel_buffer_index && ctx->channel_buffer[i].unit == ctx->channel_buffer[last_break].unit) {
+            continue;
+        }
+
+        if ((err = minify_write_corrections(ctx, &ctx->channel_buffer[last_break], &ctx->output_state[last_break], &correct[last_break], i - last_break))) {
             return err;
         }
 
         last_break = i;
     }
 
-    // TODO: ensure if last channel is different id, it is always consumed
+    return 0;
+}
+
+static int minify_upcoming_frames(struct libreorama_ctx *ctx) {
+    ctx->command_buffer_index = 0;
+
+    // iterate over channels, which are sorted by unit+circuit (see #channel_buffer_sort)
+    // each time the unit changes, push that grouping into #minify_unit
+    // i is allowed to reach channel_buffer_index so the final grouping is always consumed
+    size_t last_break = 0;
+
+    for (size_t i = 1; i <= ctx->channel_buffer_index; i++) {
+        if (i < ctx->channel_buffer_index && ctx->channel_buffer[i].unit == ctx->channel_buffer[last_break].unit) {
+            continue;
+        }
 
-    // if last_group_index == 0 and channels length > 0
-    // then all channels are in a single unit group
-    if (last_break == 0 && channel_buffer_index > 0) {
         int err;
-        if ((err = minify_unit(channel_sort_buffer[0].unit, channel_sort_buffer, upcoming_frames_buffer, channel_buffer_index))) {
+        if ((err = minify_unit(ctx, ctx->channel_buffer[last_break].unit, &ctx->channel_buffer[last_break], &ctx->output_state[last_break], &ctx->upcoming_frames_buffer[last_break], &ctx->upcoming_palette_buffer[last_break], i - last_break))) {
             return err;
         }
+
+        last_break = i;
     }
 
-    return 0;
+    const uint64_t encode_start_ns = ctx->frame_stats != NULL ? frame_stats_now_ns() : 0;
+
+    const int err = ctx->broadcast_dedup ? minify_write_commands_broadcast(ctx) : minify_write_commands(ctx, NULL);
+
+    if (ctx->frame_stats != NULL) {
+        ctx->frame_stats->frame_encode_ns += frame_stats_now_ns() - encode_start_ns;
+    }
+
+    return err;
+}
+
+int minify_frame(struct libreorama_ctx *ctx,
+                 struct sequence_t sequence,
+                 frame_index_t frame_index) {
+    // create an array of the new frame values
+    // this is derived from the sorted channels array so indexes match
+    memset(ctx->upcoming_frames_buffer, 0, sizeof(struct frame_t) * ctx->channel_buffer_index);
+    memset(ctx->upcoming_palette_buffer, 0, sizeof(frame_palette_index_t) * ctx->channel_buffer_index);
+
+    if (frame_index < sequence.frame_count) {
+        for (size_t i = 0; i < ctx->channel_buffer_index; i++) {
+            // each channel's timeline cursor advances with playback
+            const frame_palette_index_t palette_index = timeline_read(&ctx->channel_buffer[i].timeline, frame_index);
+
+            ctx->upcoming_frames_buffer[i]  = ctx->frame_palette[palette_index];
+            ctx->upcoming_palette_buffer[i] = palette_index;
+        }
+    }
+
+    return minify_upcoming_frames(ctx);
+}
+
+int minify_sync_frames(struct libreorama_ctx *ctx,
+                       const struct frame_t *frames) {
+    // forget the previously sent state so that every set frame is considered changed
+    // frames are still grouped by the usual channel masking, producing a single minimized burst
+    for (size_t i = 0; i < ctx->channel_buffer_index; i++) {
+        ctx->output_state[i].last_sent_frame    = ZERO_FRAME;
+        ctx->output_state[i].last_sent_palette  = FRAME_PALETTE_UNSET;
+        ctx->output_state[i].suppressed_frame   = ZERO_FRAME;
+        ctx->output_state[i].suppressed_palette = FRAME_PALETTE_UNSET;
+    }
+
+    return minify_frames(ctx, frames);
+}
+
+int minify_frames(struct libreorama_ctx *ctx,
+                  const struct frame_t *frames) {
+    // frames are provided by the caller, such as a compositor merging several sequences
+    // frames must be ordered to match the sorted channel_buffer
+    memcpy(ctx->upcoming_frames_buffer, frames, sizeof(struct frame_t) * ctx->channel_buffer_index);
+
+    // these frames were not interned, so they are compared by value
+    for (size_t i = 0; i < ctx->channel_buffer_index; i++) {
+        ctx->upcoming_palette_buffer[i] = FRAME_PALETTE_NONE;
+    }
+
+    return minify_upcoming_frames(ctx);
 }
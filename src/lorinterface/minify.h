@@ -27,7 +27,37 @@
 #include "frame.h"
 #include "../player/sequence.h"
 
-int minify_frame(struct sequence_t sequence,
+// brightness changes within ctx->minify_tolerance curve steps of the last sent brightness are suppressed
+// a suppressed brightness is still sent once it has settled (unchanged) for MINIFY_SETTLE_FRAMES
+// this ensures slow ramps still land on their final brightness
+#define MINIFY_SETTLE_FRAMES 4
+
+// the broadcast dedup pass keeps this many flags per channel (or command) in ctx->broadcast_dedup_flags
+#define MINIFY_BROADCAST_DEDUP_FLAG_COUNT 5
+
+// commands are collected for each frame before being encoded
+// this allows identical commands sent to several units to be replaced by a single broadcast
+struct minify_command_t {
+    lor_unit_t     unit;
+    LORChannelType channel_type;
+    lor_channel_t  channel;
+    unsigned char  channel_bank;
+    struct frame_t frame;
+    bool           unit_off;
+
+    // the unit's channels, as a range of the sorted channel_buffer
+    size_t channel_start;
+    size_t channel_len;
+};
+
+int minify_frame(struct libreorama_ctx *ctx,
+                 struct sequence_t sequence,
                  frame_index_t frame_index);
 
+int minify_sync_frames(struct libreorama_ctx *ctx,
+                       const struct frame_t *frames);
+
+int minify_frames(struct libreorama_ctx *ctx,
+                  const struct frame_t *frames);
+
 #endif //LIBREORAMA_MINIFY_H
@@ -25,8 +25,11 @@
 
 #include <string.h>
 
-struct channel_output_state_t output_state[CHANNEL_BUFFER_MAX_COUNT];
+#include "../ctx.h"
 
-void channel_output_state_reset() {
-    memset(output_state, 0, sizeof(struct channel_output_state_t) * CHANNEL_BUFFER_MAX_COUNT);
+void channel_output_state_reset(struct libreorama_ctx *ctx) {
+    // the output state is unallocated until #channel_buffer_reserve
+    if (ctx->output_state != NULL) {
+        memset(ctx->output_state, 0, sizeof(struct channel_output_state_t) * ctx->channel_buffer_capacity);
+    }
 }
@@ -29,10 +29,18 @@
 struct channel_output_state_t {
     struct frame_t last_sent_frame;
     struct frame_t pending_send_frame;
-};
 
-extern struct channel_output_state_t output_state[CHANNEL_BUFFER_MAX_COUNT];
+    // the most recent frame suppressed by the minify tolerance, if any (see minify.h)
+    struct frame_t suppressed_frame;
+    unsigned char  suppressed_age;
+
+    // the palette index of each frame above, or FRAME_PALETTE_NONE if it was not interned (see frame.h)
+    // zeroed state is FRAME_PALETTE_UNSET, matching the zeroed frames
+    frame_palette_index_t last_sent_palette;
+    frame_palette_index_t pending_send_palette;
+    frame_palette_index_t suppressed_palette;
+};
 
-void channel_output_state_reset();
+void channel_output_state_reset(struct libreorama_ctx *ctx);
 
 #endif //LIBREORAMA_STATE_H
@@ -0,0 +1,148 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "timeline.h"
+
+#include <string.h>
+
+#include "../ctx.h"
+
+// returns the run count of the frames, writing each run into the timeline's storage if timeline is not NULL
+static size_t timeline_encode_runs(const frame_palette_index_t *frames,
+                                   frame_index_t length,
+                                   struct timeline_t *timeline) {
+    size_t run_count = 0;
+
+    for (frame_index_t start = 0; start < length;) {
+        frame_index_t end = start + 1;
+
+        while (end < length && frames[end] == FRAME_PALETTE_UNSET && end - start < TIMELINE_RUN_MAX_LENGTH) {
+            end++;
+        }
+
+        if (timeline != NULL && timeline->wide) {
+            timeline->wide_runs[run_count] = (struct timeline_wide_run_t) {
+                    .length = (uint16_t) (end - start),
+                    .frame = frames[start],
+            };
+        } else if (timeline != NULL) {
+            timeline->runs[run_count] = (struct timeline_run_t) {
+                    .length = (uint16_t) (end - start),
+                    .frame = (frame_word_t) frames[start],
+            };
+        }
+
+        run_count++;
+
+        start = end;
+    }
+
+    return run_count;
+}
+
+int timeline_store(struct libreorama_ctx *ctx,
+                   struct timeline_t *timeline,
+                   const frame_palette_index_t *frames,
+                   frame_index_t frame_count) {
+    // trailing unset frames are not stored
+    frame_index_t length = frame_count;
+
+    while (length > 0 && frames[length - 1] == FRAME_PALETTE_UNSET) {
+        length--;
+    }
+
+    // a single index beyond a word widens the whole timeline, most sequences never need wide timelines
+    bool wide = false;
+
+    for (frame_index_t i = 0; i < length && !wide; i++) {
+        wide = frames[i] > FRAME_PALETTE_NARROW_MAX;
+    }
+
+    const size_t run_count   = timeline_encode_runs(frames, length, NULL);
+    const size_t frame_words = wide ? sizeof(frame_palette_index_t) / sizeof(frame_word_t) : 1;
+    const size_t run_words   = (wide ? sizeof(struct timeline_wide_run_t) : sizeof(struct timeline_run_t)) / sizeof(frame_word_t);
+
+    // runs are only smaller while at most every other frame is set
+    const bool   dense    = run_words * run_count > frame_words * length;
+    const size_t capacity = dense ? frame_words * length : run_words * run_count;
+
+    if (capacity > timeline->capacity) {
+        frame_word_t *storage;
+
+        int err;
+        if ((err = frame_buffer_request(ctx, capacity, &storage))) {
+            return err;
+        }
+
+        // the union aliases the same storage for each encoding
+        // requests are aligned for wide frames (see FRAME_BLOCK_REQUEST_ALIGNMENT)
+        timeline->frames   = storage;
+        timeline->capacity = capacity;
+    }
+
+    timeline->dense = dense;
+    timeline->wide  = wide;
+
+    if (dense && wide) {
+        memcpy(timeline->wide_frames, frames, sizeof(frame_palette_index_t) * length);
+
+        timeline->length = length;
+    } else if (dense) {
+        for (frame_index_t i = 0; i < length; i++) {
+            timeline->frames[i] = (frame_word_t) frames[i];
+        }
+
+        timeline->length = length;
+    } else {
+        timeline->length = timeline_encode_runs(frames, length, timeline);
+    }
+
+    timeline->start  = 0;
+    timeline->cursor = (struct timeline_cursor_t) {0};
+
+    return 0;
+}
+
+void timeline_decode(const struct timeline_t *timeline,
+                     frame_palette_index_t *frames,
+                     frame_index_t frame_count) {
+    memset(frames, 0, sizeof(frame_palette_index_t) * frame_count);
+
+    if (timeline->dense) {
+        const size_t length = timeline->length < frame_count ? timeline->length : frame_count;
+
+        for (size_t i = 0; i < length; i++) {
+            frames[i] = timeline->wide ? timeline->wide_frames[i] : timeline->frames[i];
+        }
+
+        return;
+    }
+
+    frame_index_t run_start = 0;
+
+    for (size_t i = 0; i < timeline->length && run_start < frame_count; i++) {
+        frames[run_start] = timeline->wide ? timeline->wide_runs[i].frame : timeline->runs[i].frame;
+
+        run_start += timeline_run_length(timeline, i);
+    }
+}
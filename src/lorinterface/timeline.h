@@ -0,0 +1,139 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LIBREORAMA_TIMELINE_H
+#define LIBREORAMA_TIMELINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame.h"
+
+// most channels hold a single frame for long stretches, so each channel's frames are stored as a timeline of runs
+// a run is a frame followed by (length - 1) unset frames, longer gaps are split into runs of unset frames
+// trailing unset frames are never stored, reading past the end of a timeline is always unset
+// busy channels, whose runs would be larger than a frame per step, are stored densely instead
+// timelines store each palette index in a single word, unless any of their indexes exceed FRAME_PALETTE_NARROW_MAX
+#define TIMELINE_RUN_MAX_LENGTH UINT16_MAX
+
+struct timeline_run_t {
+    uint16_t     length;
+    frame_word_t frame;
+};
+
+// wide runs are only word aligned within the frame arena
+struct timeline_wide_run_t {
+    uint16_t              length;
+    frame_palette_index_t frame;
+} __attribute__((packed));
+
+// runs are decoded in order by a cursor, which only moves forward
+// reading an earlier frame restarts the cursor from the first run (see #timeline_read)
+struct timeline_cursor_t {
+    size_t        run;
+    frame_index_t run_start;
+};
+
+struct timeline_t {
+    bool dense;
+
+    // wide timelines store each index in 4 bytes rather than a single word
+    bool wide;
+
+    union {
+        frame_word_t               *frames;
+        frame_palette_index_t      *wide_frames;
+        struct timeline_run_t      *runs;
+        struct timeline_wide_run_t *wide_runs;
+    };
+
+    // the stored frame count when dense, otherwise the run count
+    size_t length;
+
+    // the frame_word_t count of the storage, which may be rewritten in place by #timeline_store
+    size_t capacity;
+
+    // the frame_index of the first stored frame, frames prior to it are unset
+    // this is 0 for stored timelines, windows point each timeline at a segment of the sequence (see window.h)
+    frame_index_t start;
+
+    struct timeline_cursor_t cursor;
+};
+
+struct libreorama_ctx;
+
+// encodes frame_count dense frames into the timeline, reusing its storage when the encoding fits
+// storage is checked out from the frame arena (see #frame_buffer_request)
+int timeline_store(struct libreorama_ctx *ctx,
+                   struct timeline_t *timeline,
+                   const frame_palette_index_t *frames,
+                   frame_index_t frame_count);
+
+// decodes the timeline into frame_count dense frames, frames beyond the timeline are unset
+void timeline_decode(const struct timeline_t *timeline,
+                     frame_palette_index_t *frames,
+                     frame_index_t frame_count);
+
+static inline uint16_t timeline_run_length(const struct timeline_t *timeline,
+                                           size_t run) {
+    return timeline->wide ? timeline->wide_runs[run].length : timeline->runs[run].length;
+}
+
+// returns the palette index of the frame at frame_index, advancing the timeline's cursor
+// sequential reads (as by #minify_frame) are constant time
+static inline frame_palette_index_t timeline_read(struct timeline_t *timeline,
+                                                  frame_index_t frame_index) {
+    if (frame_index < timeline->start) {
+        return FRAME_PALETTE_UNSET;
+    }
+
+    frame_index -= timeline->start;
+
+    if (timeline->dense) {
+        if (frame_index >= timeline->length) {
+            return FRAME_PALETTE_UNSET;
+        }
+
+        return timeline->wide ? timeline->wide_frames[frame_index] : timeline->frames[frame_index];
+    }
+
+    struct timeline_cursor_t *cursor = &timeline->cursor;
+
+    if (frame_index < cursor->run_start) {
+        *cursor = (struct timeline_cursor_t) {0};
+    }
+
+    while (cursor->run < timeline->length && frame_index - cursor->run_start >= timeline_run_length(timeline, cursor->run)) {
+        cursor->run_start += timeline_run_length(timeline, cursor->run);
+        cursor->run++;
+    }
+
+    if (cursor->run >= timeline->length || frame_index != cursor->run_start) {
+        return FRAME_PALETTE_UNSET;
+    }
+
+    return timeline->wide ? timeline->wide_runs[cursor->run].frame : timeline->runs[cursor->run].frame;
+}
+
+#endif //LIBREORAMA_TIMELINE_H
@@ -25,13 +25,27 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <getopt.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
 #include <string.h>
 
+#include <libxml/parser.h>
+
+#include "ctx.h"
+#include "daemon.h"
 #include "err/al.h"
 #include "err/sp.h"
 #include "err/lbr.h"
+#include "lorinterface/brightness.h"
+#include "lorinterface/duration.h"
+#include "player/compositor.h"
+#include "player/framestats.h"
 #include "player/player.h"
 #include "lorinterface/encode.h"
+#include "metrics.h"
+#include "realtime.h"
+#include "trace.h"
 
 static void print_usage(void) {
     printf("Usage: libreorama [options] <serial port name>\n");
@@ -41,10 +55,47 @@ static void print_usage(void) {
     printf("\t-f <show file path> (defaults to \"show.txt\")\n");
     printf("\t-c <time correction offset in milliseconds> (defaults to 0)\n");
     printf("\t-l <show loop count> (defaults to 1, \"i\" to infinitely loop)\n");
+    printf("\t-d <control socket path> (runs as a daemon, sequences are provided over the socket)\n");
+    printf("\t-a <layer sequence file path> (looped beneath each sequence, may be repeated)\n");
+    printf("\t-m <layer merge mode> (\"htp\" or \"ltp\", defaults to \"htp\")\n");
+    printf("\t-g [unit:]<brightness curve> (\"squared\", \"linear\" or \"gamma\", defaults to \"squared\" for all units)\n");
+    printf("\t-t <minify tolerance in brightness curve steps> (defaults to 0, small brightness changes are suppressed when set)\n");
+    printf("\t-x (replaces identical commands sent to several units with a broadcast, every unit on the network must be in the sequence)\n");
+    printf("\t-B (addresses circuits beyond 16 with banked channel masks, every unit on the network must support them)\n");
+    printf("\t-w <window length in seconds> (decodes each sequence as it is played using a fixed amount of memory, ignored with -a)\n");
+    printf("\t-r <render output file path> (renders the show as fast as possible, without audio or serial output, not supported with -d)\n");
+    printf("\t-p <real-time priority> (plays with SCHED_FIFO at the given priority, locking and prefaulting all memory)\n");
+    printf("\t-k <cpu> (pins playback to the given cpu)\n");
+    printf("\t-T <trace file path> (writes a Chrome trace event file of each load & frame stage)\n");
+    printf("\t-M <metrics file path> (rewrites playback metrics in the Prometheus text format each second)\n");
 }
 
-static struct sp_port  *serial_port = NULL;
-static struct player_t player;
+static struct sp_port         *serial_port = NULL;
+static struct player_t        player;
+static struct libreorama_ctx ctx;
+
+// layer sequences are each loaded into their own context
+// the compositor merges them with the played sequence into output_ctx
+static struct libreorama_ctx layer_ctxs[COMPOSITOR_MAX_LAYERS - 1];
+static size_t                layer_count;
+static struct libreorama_ctx output_ctx;
+static struct compositor_t   compositor;
+
+// output configuration, applied to whichever context minifies & encodes output
+static unsigned char unit_curves[UCHAR_MAX + 1];
+static unsigned char minify_tolerance;
+static bool          broadcast_dedup;
+static bool          channel_banks;
+
+// frame loop histograms, printed at the end of each sequence and on SIGUSR1
+static struct frame_stats_t frame_stats;
+
+// running playback counters, exported when a metrics file path is provided
+static struct metrics_t metrics;
+
+static bool          has_alut;
+static FILE          *render_file = NULL;
+static unsigned long render_frame_count;
 
 static int sp_init_port(const char *device_name,
                         int baud_rate) {
@@ -76,27 +127,51 @@ static void handle_exit(void) {
         }
     }
 
+    // the metrics thread reads ctx state, it is stopped before anything is released
+    metrics_stop(&metrics);
+
     // free the player, it will safely handle partially initialized state internally
     // this will not modify player, be aware of potential dangling pointers
-    player_free(&player);
+    player_free(&ctx, &player);
+
+    // release any sequence data still held by the contexts
+    libreorama_ctx_free(&ctx);
+    libreorama_ctx_free(&output_ctx);
+
+    for (size_t i = 0; i < layer_count; i++) {
+        libreorama_ctx_free(&layer_ctxs[i]);
+    }
 
-    // fire alutExit, this assumes it was initialized already
+    // pairs with the single #xmlInitParser call in main
+    xmlCleanupParser();
+
+    // writes any remaining spans, this is a no-op if tracing was never opened
+    trace_close();
+
+    if (render_file != NULL) {
+        fclose(render_file);
+    }
+
+    // fire alutExit only if initialized, render mode never initializes ALUT
     // this must happen after #player_free since player holds OpenAL sources/buffers
-    alutExit();
+    if (has_alut) {
+        alutExit();
 
-    ALenum err;
-    if ((err = al_get_error()) != AL_NO_ERROR) {
-        al_perror(err, "failed to exit ALUT");
+        ALenum err;
+        if ((err = al_get_error()) != AL_NO_ERROR) {
+            al_perror(err, "failed to exit ALUT");
+        }
     }
 }
 
-static int handle_frame_interrupt(unsigned short step_time_ms) {
-    if (encode_buffer_index > 0 && serial_port != NULL) {
+static int handle_frame_interrupt(struct libreorama_ctx *ctx,
+                                  unsigned short step_time_ms) {
+    if (ctx->encode_buffer_index > 0 && serial_port != NULL) {
         enum sp_return sp_return;
 
         // sp_nonblocking_write returns bytes written when non-error (<0 - SP_OK)
         // feed step_time_ms as timeout to avoid blocking writes from stalling playback
-        if ((sp_return = sp_blocking_write(serial_port, encode_buffer, encode_buffer_index, step_time_ms / 2u)) < SP_OK) {
+        if ((sp_return = sp_blocking_write(serial_port, ctx->encode_buffer, ctx->encode_buffer_index, step_time_ms / 2u)) < SP_OK) {
             sp_perror(sp_return, "failed to write frame data to serial port");
             return LBR_ESPERR;
         }
@@ -104,22 +179,111 @@ static int handle_frame_interrupt(unsigned short step_time_ms) {
 
     // reset the encode buffer writer back to 0
     // always fire regardless of serial_port to avoid over allocating
-    encode_buffer_reset();
+    encode_buffer_reset(ctx);
+
+    return 0;
+}
+
+static int parse_unit_curve(const char *arg) {
+    enum brightness_curve_t curve;
+
+    // a curve without a unit prefix applies to all units
+    const char *separator = strchr(arg, ':');
+
+    if (separator == NULL) {
+        if (brightness_curve_parse(arg, &curve)) {
+            return 1;
+        }
+
+        memset(unit_curves, curve, sizeof(unit_curves));
+        return 0;
+    }
+
+    char      *end;
+    const long unitl = strtol(arg, &end, 10);
+
+    if (end != separator || unitl < 0 || unitl >= LOR_UNIT_ID_BROADCAST || brightness_curve_parse(separator + 1, &curve)) {
+        return 1;
+    }
+
+    unit_curves[unitl] = (unsigned char) curve;
+    return 0;
+}
+
+static void apply_output_config(struct libreorama_ctx *output) {
+    for (int unit = 0; unit <= UCHAR_MAX; unit++) {
+        brightness_set_unit_curve(output, (lor_unit_t) unit, (enum brightness_curve_t) unit_curves[unit]);
+    }
+
+    output->minify_tolerance = minify_tolerance;
+    output->broadcast_dedup  = broadcast_dedup;
+    output->channel_banks    = channel_banks;
+    output->frame_stats      = &frame_stats;
+}
+
+static void handle_stats_signal(int signum) {
+    // printing is deferred to the frame loop, which observes the flag after its next frame
+    frame_stats.print_requested = 1;
+
+    (void) signum;
+}
+
+static int handle_render_frame_interrupt(struct libreorama_ctx *ctx,
+                                         unsigned short step_time_ms) {
+    // each frame is written as a record of its frame number (4 bytes) and byte count (4 bytes)
+    //  in little endian, followed by the encoded bytes that would have been written to the serial port
+    // the encode buffer is sized per channel, so a single frame may exceed 65535 bytes
+    const unsigned char header[8] = {
+            (unsigned char) render_frame_count,
+            (unsigned char) (render_frame_count >> 8u),
+            (unsigned char) (render_frame_count >> 16u),
+            (unsigned char) (render_frame_count >> 24u),
+            (unsigned char) ctx->encode_buffer_index,
+            (unsigned char) (ctx->encode_buffer_index >> 8u),
+            (unsigned char) (ctx->encode_buffer_index >> 16u),
+            (unsigned char) (ctx->encode_buffer_index >> 24u),
+    };
+
+    if (fwrite(header, sizeof(header), 1, render_file) != 1) {
+        return LBR_EERRNO;
+    }
+
+    if (ctx->encode_buffer_index > 0 && fwrite(ctx->encode_buffer, ctx->encode_buffer_index, 1, render_file) != 1) {
+        return LBR_EERRNO;
+    }
+
+    render_frame_count++;
+
+    encode_buffer_reset(ctx);
+
+    (void) step_time_ms;
 
     return 0;
 }
 
 int main(int argc,
          char **argv) {
-    int            baud_rate          = 19200;
-    char           *show_file_path    = "show.txt";
-    unsigned short time_correction_ms = 0;
-    int            show_loop_count    = 1;
+    int                      baud_rate          = 19200;
+    char                     *show_file_path    = "show.txt";
+    unsigned short           time_correction_ms = 0;
+    int                      show_loop_count    = 1;
+    char                     *socket_path       = NULL;
+    char                     *layer_file_paths[COMPOSITOR_MAX_LAYERS - 1];
+    size_t                   layer_file_count   = 0;
+    enum compositor_merge_t  layer_merge        = COMPOSITOR_MERGE_HTP;
+    char                     *render_file_path  = NULL;
+    char                     *trace_file_path   = NULL;
+    char                     *metrics_file_path = NULL;
+    unsigned long            window_ms          = 0;
+    struct realtime_config_t realtime_config    = (struct realtime_config_t) {
+            .priority = 0,
+            .cpu = REALTIME_CPU_NONE,
+        };
 
     // prefix optstring with : to enable missing option case
     // see "man 3 getopt" for more information
     int c;
-    while ((c = getopt(argc, argv, ":hb:f:c:l:")) != -1) {
+    while ((c = getopt(argc, argv, ":hb:f:c:l:d:a:m:g:t:xBw:r:p:k:T:M:")) != -1) {
         switch (c) {
             case 'h':
                 print_usage();
@@ -159,6 +323,97 @@ int main(int argc,
                 time_correction_ms = (unsigned short) time_correction_msl;
                 break;
             }
+            case 'd': {
+                socket_path = optarg;
+                break;
+            }
+            case 'a': {
+                if (layer_file_count >= COMPOSITOR_MAX_LAYERS - 1) {
+                    fprintf(stderr, "too many layer sequences, max is %d\n", COMPOSITOR_MAX_LAYERS - 1);
+                    return 1;
+                }
+                layer_file_paths[layer_file_count++] = optarg;
+                break;
+            }
+            case 'm': {
+                if (strcmp(optarg, "htp") == 0) {
+                    layer_merge = COMPOSITOR_MERGE_HTP;
+                } else if (strcmp(optarg, "ltp") == 0) {
+                    layer_merge = COMPOSITOR_MERGE_LTP;
+                } else {
+                    fprintf(stderr, "invalid layer merge mode: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case 'g': {
+                if (parse_unit_curve(optarg)) {
+                    fprintf(stderr, "invalid brightness curve: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case 't': {
+                long tolerancel = strtol(optarg, NULL, 10);
+
+                if (tolerancel < 0 || tolerancel > UCHAR_MAX) {
+                    fprintf(stderr, "invalid minify tolerance: %ld\n", tolerancel);
+                    return 1;
+                }
+                minify_tolerance = (unsigned char) tolerancel;
+                break;
+            }
+            case 'x': {
+                broadcast_dedup = true;
+                break;
+            }
+            case 'B': {
+                channel_banks = true;
+                break;
+            }
+            case 'w': {
+                long window_sl = strtol(optarg, NULL, 10);
+
+                // the window is stored in milliseconds, see ctx.h
+                if (window_sl <= 0 || window_sl > USHRT_MAX) {
+                    fprintf(stderr, "invalid window length: %ld\n", window_sl);
+                    return 1;
+                }
+                window_ms = (unsigned long) window_sl * 1000;
+                break;
+            }
+            case 'r': {
+                render_file_path = optarg;
+                break;
+            }
+            case 'p': {
+                long priorityl = strtol(optarg, NULL, 10);
+
+                if (priorityl < sched_get_priority_min(SCHED_FIFO) || priorityl > sched_get_priority_max(SCHED_FIFO)) {
+                    fprintf(stderr, "invalid real-time priority: %ld\n", priorityl);
+                    return 1;
+                }
+                realtime_config.priority = (int) priorityl;
+                break;
+            }
+            case 'k': {
+                long cpul = strtol(optarg, NULL, 10);
+
+                if (cpul < 0 || cpul >= sysconf(_SC_NPROCESSORS_CONF)) {
+                    fprintf(stderr, "invalid cpu: %ld\n", cpul);
+                    return 1;
+                }
+                realtime_config.cpu = (int) cpul;
+                break;
+            }
+            case 'T': {
+                trace_file_path = optarg;
+                break;
+            }
+            case 'M': {
+                metrics_file_path = optarg;
+                break;
+            }
             case 'l': {
                 if (strncmp(optarg, "i", 1) == 0) {
                     // a -1 show_loop_count value indicates and infinite loop
@@ -184,35 +439,143 @@ int main(int argc,
     argc -= optind;
     argv += optind;
 
+    // render mode only plays a show file, the daemon always outputs to the serial port & OpenAL
+    if (render_file_path != NULL && socket_path != NULL) {
+        fprintf(stderr, "render mode (-r) cannot be used with daemon mode (-d)\n");
+        return 1;
+    }
+
+    libreorama_ctx_init(&ctx);
+    apply_output_config(&ctx);
+
+    // only the played sequence is windowed, layers are loaded into their own contexts
+    ctx.window_ms = window_ms;
+
+    // brightness & duration tables are shared by all contexts and must be built before any sequence is loaded
+    // the duration table is only read by the fixed point conversion
+    brightness_tables_init();
+#ifdef LIBREORAMA_FIXED_POINT
+    duration_table_init();
+#endif
+
+    // libxml2 requires a single process-wide initialization before any parsing
+    // this is done once here rather than per load so that contexts may load concurrently
+    xmlInitParser();
+
     atexit(handle_exit);
 
+    signal(SIGUSR1, handle_stats_signal);
+
     // initialize the serial port name from argv
     // cleanup of any successfully opened sp_port is handled by #handle_exit
     int err;
 
-    if (argc > 0) {
-        if ((err = sp_init_port(argv[0], baud_rate))) {
-            lbr_perror(err, "failed to initialize serial port");
+    // tracing is opened first so that loading is also traced
+    if (trace_file_path != NULL && (err = trace_open(trace_file_path))) {
+        lbr_perror(err, "failed to open trace file");
+        return 1;
+    }
+
+    // the metrics thread is started before real-time mode is entered, see #metrics_start
+    if (metrics_file_path != NULL) {
+        metrics_init(&metrics, render_file_path == NULL ? baud_rate : 0);
+
+        if ((err = metrics_start(&metrics, metrics_file_path))) {
+            lbr_perror(err, "failed to start metrics");
+            return 1;
+        }
+
+        ctx.metrics = &metrics;
+    }
+
+    // render mode replaces both the serial port and OpenAL with the render file
+    if (render_file_path != NULL) {
+        if ((render_file = fopen(render_file_path, "wb")) == NULL) {
+            lbr_perror(LBR_EERRNO, "failed to open render file");
             return 1;
         }
     } else {
-        fprintf(stderr, "no serial port specified, defaulting to NULL (no output)\n");
+        if (argc > 0) {
+            if ((err = sp_init_port(argv[0], baud_rate))) {
+                lbr_perror(err, "failed to initialize serial port");
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "no serial port specified, defaulting to NULL (no output)\n");
+        }
+
+        // initialize ALUT
+        alutInit(NULL, NULL);
+
+        ALenum al_err;
+        if ((al_err = al_get_error()) != AL_NO_ERROR) {
+            al_perror(al_err, "failed to initialize ALUT");
+            return 1;
+        }
+
+        has_alut = true;
     }
 
-    // initialize ALUT
-    alutInit(NULL, NULL);
+    // load each layer sequence once, they remain resident for the program lifetime
+    // when any layers are present, every played sequence is composited on top of them
+    if (layer_file_count > 0) {
+        libreorama_ctx_init(&output_ctx);
+        apply_output_config(&output_ctx);
+        compositor_init(&compositor, &output_ctx, layer_merge);
 
-    ALenum al_err;
-    if ((al_err = al_get_error()) != AL_NO_ERROR) {
-        al_perror(al_err, "failed to initialize ALUT");
-        return 1;
+        for (size_t i = 0; i < layer_file_count; i++) {
+            struct sequence_t layer_sequence;
+
+            libreorama_ctx_init(&layer_ctxs[i]);
+            layer_count++;
+
+            if ((err = player_load_layer(&layer_ctxs[i], layer_file_paths[i], &layer_sequence))) {
+                lbr_perror(err, "failed to load layer sequence");
+                return 1;
+            }
+
+            if ((err = compositor_push_layer(&compositor, &layer_ctxs[i], layer_sequence, true))) {
+                lbr_perror(err, "failed to add layer sequence");
+                return 1;
+            }
+        }
+
+        ctx.compositor = &compositor;
+    }
+
+    // real-time mode is entered after OpenAL is initialized so its threads keep the default policy
+    // render mode never sleeps between frames, and would otherwise starve the cpu
+    if (render_file == NULL && (realtime_config.priority > 0 || realtime_config.cpu != REALTIME_CPU_NONE)) {
+        if ((err = realtime_enter(&realtime_config))) {
+            lbr_perror(err, "failed to enter real-time mode");
+            return 1;
+        }
+
+        ctx.realtime_prefault = realtime_config.priority > 0;
+    }
+
+    // in daemon mode, the player is initialized without a show file
+    // sequences are instead queued by control socket clients
+    if (socket_path != NULL) {
+        if ((err = player_init(&ctx, &player, NULL))) {
+            lbr_perror(err, "failed to initialize player");
+            return 1;
+        }
+
+        // daemon_run returns on fatal errors, or once SIGINT or SIGTERM has been received
+        if ((err = daemon_run(&ctx, socket_path, handle_frame_interrupt, time_correction_ms))) {
+            lbr_perror(err, "failed to run daemon");
+            return 1;
+        }
+
+        return 0;
     }
 
     // initialize player and load show file
     // player_init handles error printing internally
     player.show_loop_count = show_loop_count;
 
-    if ((err = player_init(&player, show_file_path))) {
+    if ((err = player_init(&ctx, &player, show_file_path))) {
         lbr_perror(err, "failed to initialize player");
         return 1;
     }
@@ -226,7 +589,7 @@ int main(int argc,
     // FIXME: safely handle empty show file
 
     while (true) {
-        if ((err = player_next_sequence(&player, &next_sequence_file))) {
+        if ((err = player_next_sequence(&ctx, &player, &next_sequence_file))) {
             lbr_perror(err, "failed to read next sequence");
             return 1;
         }
@@ -238,9 +601,19 @@ int main(int argc,
             return 0;
         }
 
+        // render mode plays the sequence as fast as possible into the render file
+        if (render_file != NULL) {
+            if ((err = player_render(&ctx, handle_render_frame_interrupt, next_sequence_file))) {
+                lbr_perror(err, "failed to render sequence");
+                return 1;
+            }
+
+            continue;
+        }
+
         // load and buffer the sequence
         // this will internally block for playback
-        if ((err = player_start(handle_frame_interrupt, time_correction_ms, next_sequence_file))) {
+        if ((err = player_start(&ctx, handle_frame_interrupt, time_correction_ms, next_sequence_file))) {
             lbr_perror(err, "failed to start player");
             return 1;
         }
@@ -0,0 +1,299 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "metrics.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "err/lbr.h"
+
+// large enough for the full exposition, including the longest (escaped) sequence path
+#define METRICS_FORMAT_MAX_LENGTH 4096
+
+#define METRICS_FILE_PATH_MAX_LENGTH 256
+
+#define METRICS_STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+#define METRICS_LOAD(field)         __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define METRICS_ADD(field, value)   __atomic_fetch_add(&(field), (value), __ATOMIC_RELAXED)
+
+// each frame is sent as 8N1 serial, 10 bits per byte
+#define METRICS_BITS_PER_BYTE 10
+
+static const struct metrics_t METRICS_EMPTY;
+
+void metrics_init(struct metrics_t *metrics,
+                  int baud_rate) {
+    *metrics = METRICS_EMPTY;
+
+    metrics->baud_rate = baud_rate;
+
+    pthread_mutex_init(&metrics->sequence_mutex, NULL);
+}
+
+void metrics_set_sequence(struct metrics_t *metrics,
+                          const char *sequence_file) {
+    pthread_mutex_lock(&metrics->sequence_mutex);
+
+    strncpy(metrics->sequence, sequence_file, sizeof(metrics->sequence) - 1);
+    metrics->sequence[sizeof(metrics->sequence) - 1] = 0;
+
+    pthread_mutex_unlock(&metrics->sequence_mutex);
+}
+
+void metrics_set_playing(struct metrics_t *metrics,
+                         bool playing) {
+    METRICS_STORE(metrics->playing, playing);
+}
+
+void metrics_set_load_time(struct metrics_t *metrics,
+                           unsigned long load_us,
+                           unsigned long audio_decode_us) {
+    METRICS_STORE(metrics->load_us, load_us);
+    METRICS_STORE(metrics->audio_decode_us, audio_decode_us);
+}
+
+void metrics_record_frame(struct metrics_t *metrics,
+                          unsigned long frame_index,
+                          size_t frame_bytes,
+                          bool late) {
+    METRICS_STORE(metrics->frame_index, frame_index);
+    METRICS_ADD(metrics->frames_total, 1);
+    METRICS_ADD(metrics->serial_bytes_total, (unsigned long) frame_bytes);
+
+    if (late) {
+        METRICS_ADD(metrics->frames_late_total, 1);
+    }
+
+    // the playback thread is the only writer, so a plain load & store is sufficient
+    if (frame_bytes > METRICS_LOAD(metrics->encode_buffer_high_water)) {
+        METRICS_STORE(metrics->encode_buffer_high_water, (unsigned long) frame_bytes);
+    }
+}
+
+void metrics_set_audio_drift(struct metrics_t *metrics,
+                             long audio_drift_us) {
+    METRICS_STORE(metrics->audio_drift_us, audio_drift_us);
+}
+
+// appends a single metric with its HELP & TYPE lines, returning the new length of buf
+static size_t metrics_append(char *buf,
+                             size_t len,
+                             size_t index,
+                             const char *name,
+                             const char *type,
+                             const char *help,
+                             const char *value) {
+    if (index >= len) {
+        return index;
+    }
+
+    const int written = snprintf(&buf[index], len - index, "# HELP %s %s\n# TYPE %s %s\n%s %s\n", name, help, name, type, name, value);
+
+    return written < 0 ? index : index + (size_t) written;
+}
+
+// copies the sequence into buf, escaping it as a label value
+static void metrics_escape_sequence(struct metrics_t *metrics,
+                                    char *buf) {
+    size_t index = 0;
+
+    pthread_mutex_lock(&metrics->sequence_mutex);
+
+    for (const char *c = metrics->sequence; *c != 0; c++) {
+        if (*c == '\\' || *c == '"') {
+            buf[index++] = '\\';
+            buf[index++] = *c;
+        } else if (*c == '\n') {
+            buf[index++] = '\\';
+            buf[index++] = 'n';
+        } else {
+            buf[index++] = *c;
+        }
+    }
+
+    pthread_mutex_unlock(&metrics->sequence_mutex);
+
+    buf[index] = 0;
+}
+
+size_t metrics_format(struct metrics_t *metrics,
+                      char *buf,
+                      size_t len) {
+    char   sequence[METRICS_SEQUENCE_MAX_LENGTH * 2];
+    char   value[64];
+    size_t index = 0;
+
+    metrics_escape_sequence(metrics, sequence);
+
+    // the sequence is exported as a label of an info metric
+    const int written = snprintf(buf, len, "# HELP libreorama_sequence_info The current (or last played) sequence.\n# TYPE libreorama_sequence_info gauge\nlibreorama_sequence_info{sequence=\"%s\"} 1\n", sequence);
+
+    if (written > 0) {
+        index = (size_t) written < len ? (size_t) written : len;
+    }
+
+    snprintf(value, sizeof(value), "%d", METRICS_LOAD(metrics->playing) ? 1 : 0);
+    index = metrics_append(buf, len, index, "libreorama_playing", "gauge", "Whether a sequence is playing.", value);
+
+    snprintf(value, sizeof(value), "%lu", METRICS_LOAD(metrics->frame_index));
+    index = metrics_append(buf, len, index, "libreorama_frame_index", "gauge", "Frame index of the playing sequence.", value);
+
+    snprintf(value, sizeof(value), "%lu", METRICS_LOAD(metrics->frames_total));
+    index = metrics_append(buf, len, index, "libreorama_frames_total", "counter", "Frames played.", value);
+
+    snprintf(value, sizeof(value), "%lu", METRICS_LOAD(metrics->frames_late_total));
+    index = metrics_append(buf, len, index, "libreorama_frames_late_total", "counter", "Frames which woke later than half of their step time.", value);
+
+    snprintf(value, sizeof(value), "%lu", METRICS_LOAD(metrics->serial_bytes_total));
+    index = metrics_append(buf, len, index, "libreorama_serial_bytes_total", "counter", "Bytes written to the serial port.", value);
+
+    const unsigned long bytes_per_second = METRICS_LOAD(metrics->serial_bytes_per_second);
+
+    snprintf(value, sizeof(value), "%lu", bytes_per_second);
+    index = metrics_append(buf, len, index, "libreorama_serial_bytes_per_second", "gauge", "Bytes written to the serial port over the last interval.", value);
+
+    if (metrics->baud_rate > 0) {
+        snprintf(value, sizeof(value), "%.4f", (double) (bytes_per_second * METRICS_BITS_PER_BYTE) / metrics->baud_rate);
+        index = metrics_append(buf, len, index, "libreorama_link_utilization_ratio", "gauge", "Serial link utilization over the last interval.", value);
+    }
+
+    snprintf(value, sizeof(value), "%lu", METRICS_LOAD(metrics->encode_buffer_high_water));
+    index = metrics_append(buf, len, index, "libreorama_encode_buffer_high_water_bytes", "gauge", "Largest encode buffer written by a single frame.", value);
+
+    snprintf(value, sizeof(value), "%.6f", (double) METRICS_LOAD(metrics->audio_drift_us) / 1000000.0);
+    index = metrics_append(buf, len, index, "libreorama_audio_drift_seconds", "gauge", "Audio playback position minus the sequence position.", value);
+
+    snprintf(value, sizeof(value), "%.6f", (double) METRICS_LOAD(metrics->load_us) / 1000000.0);
+    index = metrics_append(buf, len, index, "libreorama_load_seconds", "gauge", "Time taken to load the current sequence, including audio.", value);
+
+    snprintf(value, sizeof(value), "%.6f", (double) METRICS_LOAD(metrics->audio_decode_us) / 1000000.0);
+    index = metrics_append(buf, len, index, "libreorama_audio_decode_seconds", "gauge", "Time taken to decode the current sequence's audio.", value);
+
+    return index < len ? index : len - 1;
+}
+
+static int metrics_write_file(struct metrics_t *metrics) {
+    char buf[METRICS_FORMAT_MAX_LENGTH];
+    char tmp_path[METRICS_FILE_PATH_MAX_LENGTH + 8];
+
+    const size_t len = metrics_format(metrics, buf, sizeof(buf));
+
+    // write to a temporary file and rename it over the previous file
+    // this ensures readers (such as a node exporter textfile collector) never observe a partial file
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", metrics->file_path) >= (int) sizeof(tmp_path)) {
+        return LBR_FILE_EPATHTOOLONG;
+    }
+
+    FILE *file = fopen(tmp_path, "w");
+
+    if (file == NULL) {
+        return LBR_EERRNO;
+    }
+
+    const size_t written = fwrite(buf, 1, len, file);
+
+    if (fclose(file) || written != len || rename(tmp_path, metrics->file_path)) {
+        return LBR_EERRNO;
+    }
+
+    return 0;
+}
+
+static void *metrics_thread_run(void *arg) {
+    struct metrics_t *metrics = arg;
+
+    const struct timespec interval = (struct timespec) {
+            .tv_sec = METRICS_INTERVAL_MS / 1000,
+            .tv_nsec = (long) (METRICS_INTERVAL_MS % 1000) * 1000000,
+    };
+
+    unsigned long last_serial_bytes = METRICS_LOAD(metrics->serial_bytes_total);
+
+    while (!METRICS_LOAD(metrics->stop_requested)) {
+        nanosleep(&interval, NULL);
+
+        const unsigned long serial_bytes = METRICS_LOAD(metrics->serial_bytes_total);
+
+        METRICS_STORE(metrics->serial_bytes_per_second, (serial_bytes - last_serial_bytes) * 1000u / METRICS_INTERVAL_MS);
+
+        last_serial_bytes = serial_bytes;
+
+        int err;
+        if ((err = metrics_write_file(metrics))) {
+            // the file is rewritten each interval, a failed write is reported but not fatal
+            lbr_perror(err, "failed to write metrics file");
+        }
+    }
+
+    return NULL;
+}
+
+int metrics_start(struct metrics_t *metrics,
+                  const char *file_path) {
+    metrics->file_path = file_path;
+
+    if (strlen(file_path) + 1 > METRICS_FILE_PATH_MAX_LENGTH) {
+        return LBR_FILE_EPATHTOOLONG;
+    }
+
+    // the metrics thread never inherits real-time scheduling from its creator (see realtime.h)
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+
+    const struct sched_param param = (struct sched_param) {
+            .sched_priority = 0,
+    };
+
+    pthread_attr_setschedparam(&attr, &param);
+
+    const int err = pthread_create(&metrics->thread, &attr, metrics_thread_run, metrics);
+
+    pthread_attr_destroy(&attr);
+
+    if (err) {
+        errno = err;
+        return LBR_EERRNO;
+    }
+
+    metrics->has_thread = true;
+
+    return 0;
+}
+
+void metrics_stop(struct metrics_t *metrics) {
+    if (!metrics->has_thread) {
+        return;
+    }
+
+    METRICS_STORE(metrics->stop_requested, true);
+
+    pthread_join(metrics->thread, NULL);
+
+    metrics->has_thread = false;
+}
@@ -0,0 +1,101 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LIBREORAMA_METRICS_H
+#define LIBREORAMA_METRICS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define METRICS_SEQUENCE_MAX_LENGTH 256
+
+// the metrics file is rewritten at this interval, which is also the serial rate sample window
+#define METRICS_INTERVAL_MS 1000
+
+// metrics_t holds running counters of playback, exported in the Prometheus text format
+// counters are written by the frame loop with relaxed atomics and read by the metrics thread
+// no ordering is needed between them, each value is independently monotonic or a gauge
+struct metrics_t {
+    // counters & gauges updated by the playback thread
+    // these are native word sized so that atomics are lock free on 32 bit targets (without libatomic)
+    unsigned long frame_index;
+    unsigned long frames_total;
+    unsigned long frames_late_total;
+    unsigned long serial_bytes_total;
+    unsigned long encode_buffer_high_water;
+    long          audio_drift_us;
+    unsigned long load_us;
+    unsigned long audio_decode_us;
+    bool          playing;
+
+    // computed by the metrics thread from serial_bytes_total each interval
+    unsigned long serial_bytes_per_second;
+
+    // bits per second of the serial link, used for utilization, 0 if unknown
+    int baud_rate;
+
+    // the sequence is only written between sequences, and guarded by sequence_mutex
+    pthread_mutex_t sequence_mutex;
+    char            sequence[METRICS_SEQUENCE_MAX_LENGTH];
+
+    // metrics thread state
+    const char *file_path;
+    pthread_t  thread;
+    bool       has_thread;
+    bool       stop_requested;
+};
+
+void metrics_init(struct metrics_t *metrics,
+                  int baud_rate);
+
+// starts a thread which samples rates and rewrites file_path (replacing it atomically) each interval
+int metrics_start(struct metrics_t *metrics,
+                  const char *file_path);
+
+void metrics_stop(struct metrics_t *metrics);
+
+void metrics_set_sequence(struct metrics_t *metrics,
+                          const char *sequence_file);
+
+void metrics_set_playing(struct metrics_t *metrics,
+                         bool playing);
+
+void metrics_set_load_time(struct metrics_t *metrics,
+                           unsigned long load_us,
+                           unsigned long audio_decode_us);
+
+void metrics_record_frame(struct metrics_t *metrics,
+                          unsigned long frame_index,
+                          size_t frame_bytes,
+                          bool late);
+
+void metrics_set_audio_drift(struct metrics_t *metrics,
+                             long audio_drift_us);
+
+// writes the Prometheus text exposition of metrics into buf, returning its length (excluding NUL)
+size_t metrics_format(struct metrics_t *metrics,
+                      char *buf,
+                      size_t len);
+
+#endif //LIBREORAMA_METRICS_H
@@ -0,0 +1,418 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "compositor.h"
+
+#include <limits.h>
+#include <stdint.h>
+
+#include "../ctx.h"
+#include "../err/lbr.h"
+#include "../lorinterface/keyframe.h"
+#include "../lorinterface/minify.h"
+
+#define COMPOSITOR_NO_LAYER   SIZE_MAX
+#define COMPOSITOR_NO_CHANNEL SIZE_MAX
+#define COMPOSITOR_NO_FADE_END ULONG_MAX
+
+// the output channels are unsorted while being built, so #channel_buffer_find cannot yet be used
+static size_t compositor_find_channel(const struct libreorama_ctx *ctx,
+                                      lor_unit_t unit,
+                                      lor_channel_t circuit) {
+    for (size_t i = 0; i < ctx->channel_buffer_index; i++) {
+        if (ctx->channel_buffer[i].unit == unit && ctx->channel_buffer[i].circuit == circuit) {
+            return i;
+        }
+    }
+
+    return COMPOSITOR_NO_CHANNEL;
+}
+
+static enum compositor_merge_t compositor_find_merge(const struct compositor_t *compositor,
+                                                     const struct channel_t *channel) {
+    for (size_t i = 0; i < compositor->merge_override_count; i++) {
+        const struct compositor_merge_override_t override = compositor->merge_overrides[i];
+
+        if (override.unit == channel->unit && override.circuit == channel->circuit) {
+            return override.merge;
+        }
+    }
+
+    return compositor->default_merge;
+}
+
+static int compositor_rebuild(struct compositor_t *compositor) {
+    struct libreorama_ctx *output = compositor->output;
+
+    // the output channels are the union of every layer's channels
+    // their timelines are left empty since the output context is fed by #minify_frames
+    int err;
+    if ((err = channel_buffer_reserve(output, COMPOSITOR_MAX_CHANNELS))) {
+        return err;
+    }
+
+    for (size_t layer = 0; layer < compositor->layer_count; layer++) {
+        const struct libreorama_ctx *ctx = compositor->layers[layer].ctx;
+
+        // each layer's channels are mapped through the fixed size output_index
+        if (ctx->channel_buffer_index > COMPOSITOR_MAX_CHANNELS) {
+            return LBR_SEQUENCE_EINCCHANNELBUF;
+        }
+
+        for (size_t i = 0; i < ctx->channel_buffer_index; i++) {
+            const struct channel_t channel = ctx->channel_buffer[i];
+
+            if (compositor_find_channel(output, channel.unit, channel.circuit) != COMPOSITOR_NO_CHANNEL) {
+                continue;
+            }
+
+            struct channel_t *output_channel = NULL;
+
+            if ((err = channel_buffer_request(output, channel.unit, channel.circuit, &output_channel))) {
+                return err;
+            }
+        }
+    }
+
+    channel_buffer_sort(output);
+
+    // map each layer channel to its sorted output channel
+    for (size_t layer = 0; layer < compositor->layer_count; layer++) {
+        struct compositor_layer_t *compositor_layer = &compositor->layers[layer];
+
+        for (size_t i = 0; i < compositor_layer->ctx->channel_buffer_index; i++) {
+            const struct channel_t channel = compositor_layer->ctx->channel_buffer[i];
+
+            compositor_layer->output_index[i] = channel_buffer_find(output, channel.unit, channel.circuit);
+        }
+
+        compositor_layer->next_frame_index = 0;
+    }
+
+    for (size_t i = 0; i < output->channel_buffer_index; i++) {
+        compositor->merge[i]        = compositor_find_merge(compositor, &output->channel_buffer[i]);
+        compositor->ltp_layer[i]    = COMPOSITOR_NO_LAYER;
+        compositor->winner_layer[i] = COMPOSITOR_NO_LAYER;
+
+        for (size_t layer = 0; layer < COMPOSITOR_MAX_LAYERS; layer++) {
+            compositor->held[layer][i]             = ZERO_FRAME;
+            compositor->held_frame_index[layer][i]    = 0;
+            compositor->held_fade_end_index[layer][i] = COMPOSITOR_NO_FADE_END;
+            compositor->changed[layer][i]             = false;
+        }
+    }
+
+    return 0;
+}
+
+void compositor_init(struct compositor_t *compositor,
+                     struct libreorama_ctx *output,
+                     enum compositor_merge_t default_merge) {
+    static const struct compositor_t COMPOSITOR_EMPTY;
+
+    *compositor = COMPOSITOR_EMPTY;
+
+    compositor->output        = output;
+    compositor->default_merge = default_merge;
+}
+
+int compositor_push_layer(struct compositor_t *compositor,
+                          struct libreorama_ctx *ctx,
+                          struct sequence_t sequence,
+                          bool loop) {
+    if (compositor->layer_count >= COMPOSITOR_MAX_LAYERS) {
+        return LBR_COMPOSITOR_ETOOMANYLAYERS;
+    }
+
+    // layers pushed later are higher priority when merges are tied
+    compositor->layers[compositor->layer_count++] = (struct compositor_layer_t) {
+            .ctx = ctx,
+            .sequence = sequence,
+            .loop = loop,
+    };
+
+    return compositor_rebuild(compositor);
+}
+
+void compositor_pop_layer(struct compositor_t *compositor) {
+    if (compositor->layer_count > 0) {
+        compositor->layer_count--;
+
+        // a rebuild with fewer layers cannot exceed the output channel buffer
+        compositor_rebuild(compositor);
+    }
+}
+
+int compositor_set_merge(struct compositor_t *compositor,
+                         lor_unit_t unit,
+                         lor_channel_t circuit,
+                         enum compositor_merge_t merge) {
+    if (compositor->merge_override_count >= COMPOSITOR_MAX_CHANNELS) {
+        return LBR_SEQUENCE_EINCCHANNELBUF;
+    }
+
+    compositor->merge_overrides[compositor->merge_override_count++] = (struct compositor_merge_override_t) {
+            .unit = unit,
+            .circuit = circuit,
+            .merge = merge,
+    };
+
+    const size_t output_index = channel_buffer_find(compositor->output, unit, circuit);
+
+    if (output_index != CHANNEL_BUFFER_NOT_FOUND) {
+        compositor->merge[output_index] = merge;
+    }
+
+    return 0;
+}
+
+// returns the layer's held frame as of time_ms, so a fade is resumed part way through rather than restarted
+static struct frame_t compositor_held_frame(const struct compositor_t *compositor,
+                                            size_t layer,
+                                            size_t output_index,
+                                            unsigned long time_ms) {
+    const unsigned short step_time_ms = compositor->layers[layer].sequence.step_time_ms;
+
+    const struct keyframe_state_t state = {
+            .frame = compositor->held[layer][output_index],
+            .frame_index = (frame_index_t) compositor->held_frame_index[layer][output_index],
+    };
+
+    return keyframe_sync_frame(state, (frame_index_t) (time_ms / step_time_ms), step_time_ms);
+}
+
+// returns the layer frame index at which a fade started at start_frame_index completes
+// this matches #keyframe_sync_frame, which syncs a fade to its final level once duration_cs has elapsed
+static unsigned long compositor_fade_end_index(struct frame_t frame,
+                                               unsigned long start_frame_index,
+                                               unsigned short step_time_ms) {
+    if (frame.action != LOR_ACTION_CHANNEL_FADE || frame.fade.duration_cs == 0) {
+        return COMPOSITOR_NO_FADE_END;
+    }
+
+    return start_frame_index + ((unsigned long) frame.fade.duration_cs * 10 + step_time_ms - 1) / step_time_ms;
+}
+
+// frames are expected to be synced by #compositor_held_frame, so a finished fade ranks by its final level
+static unsigned char compositor_frame_level(struct frame_t frame) {
+    switch (frame.action) {
+        case LOR_ACTION_CHANNEL_SET_BRIGHTNESS:
+            return frame.set_brightness;
+        case LOR_ACTION_CHANNEL_FADE:
+            return frame.fade.from > frame.fade.to ? frame.fade.from : frame.fade.to;
+        case LOR_ACTION_CHANNEL_ON:
+        case LOR_ACTION_CHANNEL_SHIMMER:
+        case LOR_ACTION_CHANNEL_TWINKLE:
+            return UCHAR_MAX;
+        default:
+            return 0;
+    }
+}
+
+static size_t compositor_select_layer(const struct compositor_t *compositor,
+                                      size_t output_index,
+                                      unsigned long time_ms) {
+    if (compositor->merge[output_index] == COMPOSITOR_MERGE_LTP) {
+        return compositor->ltp_layer[output_index];
+    }
+
+    // iterate in layer order so ties are won by the higher layer
+    size_t winner       = COMPOSITOR_NO_LAYER;
+    int    winner_level = -1;
+
+    for (size_t layer = 0; layer < compositor->layer_count; layer++) {
+        if (!frame_is_set(compositor->held[layer][output_index])) {
+            continue;
+        }
+
+        const struct frame_t frame = compositor_held_frame(compositor, layer, output_index, time_ms);
+
+        const int level = compositor_frame_level(frame);
+
+        if (level >= winner_level) {
+            winner       = layer;
+            winner_level = level;
+        }
+    }
+
+    return winner;
+}
+
+// frame_index is wrapped for looping layers, while start_frame_index continues counting through each loop
+static void compositor_apply_frame(struct compositor_t *compositor,
+                                   size_t layer,
+                                   unsigned long frame_index,
+                                   unsigned long start_frame_index) {
+    const struct compositor_layer_t *compositor_layer = &compositor->layers[layer];
+    struct libreorama_ctx           *ctx              = compositor_layer->ctx;
+
+    for (size_t i = 0; i < ctx->channel_buffer_index; i++) {
+        // looping layers restart their timeline cursors each time they wrap
+        const struct frame_t frame = ctx->frame_palette[timeline_read(&ctx->channel_buffer[i].timeline, (frame_index_t) frame_index)];
+
+        if (!frame_is_set(frame)) {
+            continue;
+        }
+
+        const size_t output_index = compositor_layer->output_index[i];
+
+        compositor->held[layer][output_index]                = frame;
+        compositor->held_frame_index[layer][output_index]    = start_frame_index;
+        compositor->held_fade_end_index[layer][output_index] = compositor_fade_end_index(frame, start_frame_index, compositor_layer->sequence.step_time_ms);
+        compositor->changed[layer][output_index]             = true;
+        compositor->ltp_layer[output_index]                  = layer;
+    }
+}
+
+static void compositor_advance_layer(struct compositor_t *compositor,
+                                     size_t layer,
+                                     unsigned long time_ms) {
+    struct compositor_layer_t *compositor_layer = &compositor->layers[layer];
+
+    const unsigned long frame_count  = compositor_layer->sequence.frame_count;
+    const unsigned long target_index = time_ms / compositor_layer->sequence.step_time_ms;
+
+    // layers may use a shorter step time than the output
+    // apply every frame since the last tick so no effect starts are skipped
+    unsigned long frame_index = compositor_layer->next_frame_index;
+
+    if (target_index >= frame_count && frame_index + frame_count <= target_index) {
+        frame_index = target_index - frame_count + 1;
+    }
+
+    for (; frame_index <= target_index; frame_index++) {
+        if (compositor_layer->loop) {
+            compositor_apply_frame(compositor, layer, frame_index % frame_count, frame_index);
+        } else if (frame_index < frame_count) {
+            compositor_apply_frame(compositor, layer, frame_index, frame_index);
+        }
+    }
+
+    compositor_layer->next_frame_index = target_index + 1;
+}
+
+int compositor_seek(struct compositor_t *compositor,
+                    unsigned long time_ms) {
+    struct libreorama_ctx *output = compositor->output;
+
+    for (size_t layer = 0; layer < compositor->layer_count; layer++) {
+        struct compositor_layer_t *compositor_layer = &compositor->layers[layer];
+
+        const unsigned long frame_count  = compositor_layer->sequence.frame_count;
+        const unsigned long target_index = time_ms / compositor_layer->sequence.step_time_ms;
+
+        // non-looping layers which have already ended are restored to their final state
+        const unsigned long layer_index = compositor_layer->loop ? target_index % frame_count : target_index;
+        const frame_index_t frame_index = (frame_index_t) (layer_index < frame_count ? layer_index : frame_count);
+
+        // restore each layer's state prior to target_index from its keyframe index
+        const struct frame_t *frames = NULL;
+
+        int err;
+        if ((err = keyframe_restore(compositor_layer->ctx, compositor_layer->sequence, frame_index, &frames))) {
+            return err;
+        }
+
+        for (size_t i = 0; i < compositor_layer->ctx->channel_buffer_index; i++) {
+            const size_t output_index = compositor_layer->output_index[i];
+
+            compositor->held[layer][output_index]    = frames[i];
+            compositor->changed[layer][output_index] = false;
+
+            // restored frames are synced as of frame_index, or target_index for looping layers
+            compositor->held_frame_index[layer][output_index] = compositor_layer->loop ? target_index : frame_index;
+
+            compositor->held_fade_end_index[layer][output_index] = compositor_fade_end_index(frames[i], compositor->held_frame_index[layer][output_index], compositor_layer->sequence.step_time_ms);
+
+            // the relative start order of restored effects is not known
+            // the highest layer with a restored effect is assumed to be latest
+            if (frame_is_set(frames[i])) {
+                compositor->ltp_layer[output_index] = layer;
+            }
+        }
+
+        compositor_layer->next_frame_index = target_index;
+    }
+
+    for (size_t i = 0; i < output->channel_buffer_index; i++) {
+        const size_t winner = compositor_select_layer(compositor, i, time_ms);
+
+        compositor->winner_layer[i]  = winner;
+        compositor->merged_frames[i] = winner == COMPOSITOR_NO_LAYER ? ZERO_FRAME : compositor_held_frame(compositor, winner, i, time_ms);
+    }
+
+    // write the merged state as a single minimized burst
+    return minify_sync_frames(output, compositor->merged_frames);
+}
+
+int compositor_frame(struct compositor_t *compositor,
+                     unsigned long time_ms) {
+    struct libreorama_ctx *output = compositor->output;
+
+    for (size_t layer = 0; layer < compositor->layer_count; layer++) {
+        compositor_advance_layer(compositor, layer, time_ms);
+    }
+
+    for (size_t i = 0; i < output->channel_buffer_index; i++) {
+        bool changed = false;
+
+        for (size_t layer = 0; layer < compositor->layer_count; layer++) {
+            changed |= compositor->changed[layer][i];
+
+            // a held fade which completes this tick lowers its level without a new frame
+            // the winner is selected again, so a brighter layer beneath it is revealed
+            const unsigned long frame_index = time_ms / compositor->layers[layer].sequence.step_time_ms;
+
+            if (compositor->held_fade_end_index[layer][i] <= frame_index) {
+                compositor->held_fade_end_index[layer][i] = COMPOSITOR_NO_FADE_END;
+
+                changed = true;
+            }
+        }
+
+        compositor->merged_frames[i] = ZERO_FRAME;
+
+        if (!changed) {
+            continue;
+        }
+
+        const size_t winner = compositor_select_layer(compositor, i, time_ms);
+
+        // only output the winning frame when the winner itself changed
+        // changes to a layer which remains hidden beneath the winner are not output
+        // a newly revealed layer resumes its held frame as of time_ms, rather than restarting its fade
+        if (winner != COMPOSITOR_NO_LAYER && (winner != compositor->winner_layer[i] || compositor->changed[winner][i])) {
+            compositor->merged_frames[i] = compositor_held_frame(compositor, winner, i, time_ms);
+        }
+
+        compositor->winner_layer[i] = winner;
+
+        for (size_t layer = 0; layer < compositor->layer_count; layer++) {
+            compositor->changed[layer][i] = false;
+        }
+    }
+
+    // the merged frames share a single minify/encode pass
+    // this ensures merged output is still masked & minimized on the wire
+    return minify_frames(output, compositor->merged_frames);
+}
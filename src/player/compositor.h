@@ -0,0 +1,103 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LIBREORAMA_COMPOSITOR_H
+#define LIBREORAMA_COMPOSITOR_H
+
+#include <stdbool.h>
+
+#include "sequence.h"
+
+#define COMPOSITOR_MAX_LAYERS 4
+
+// the merged output, and each layer, is limited to this many channels
+// the output context's channel buffer is reserved at this capacity (see #channel_buffer_reserve)
+#define COMPOSITOR_MAX_CHANNELS 128
+
+enum compositor_merge_t {
+    // highest takes precedence, the brightest layer wins
+    COMPOSITOR_MERGE_HTP,
+    // latest takes precedence, the layer with the most recently started effect wins
+    COMPOSITOR_MERGE_LTP
+};
+
+struct compositor_layer_t {
+    struct libreorama_ctx *ctx;
+    struct sequence_t     sequence;
+    bool                  loop;
+    unsigned long         next_frame_index;
+    size_t                output_index[COMPOSITOR_MAX_CHANNELS];
+};
+
+struct compositor_merge_override_t {
+    lor_unit_t              unit;
+    lor_channel_t           circuit;
+    enum compositor_merge_t merge;
+};
+
+// layers are merged by the output channel (unit+circuit) they share
+// held frames are the most recently started effect of each layer, indexed by output channel
+// held_frame_index is the layer frame index each held frame started at, counting through loops
+// held_fade_end_index is the layer frame index a held fade completes at, so the winner may be selected again
+struct compositor_t {
+    struct libreorama_ctx     *output;
+    struct compositor_layer_t layers[COMPOSITOR_MAX_LAYERS];
+    size_t                    layer_count;
+    enum compositor_merge_t   default_merge;
+    enum compositor_merge_t   merge[COMPOSITOR_MAX_CHANNELS];
+
+    struct compositor_merge_override_t merge_overrides[COMPOSITOR_MAX_CHANNELS];
+    size_t                             merge_override_count;
+
+    struct frame_t            held[COMPOSITOR_MAX_LAYERS][COMPOSITOR_MAX_CHANNELS];
+    unsigned long             held_frame_index[COMPOSITOR_MAX_LAYERS][COMPOSITOR_MAX_CHANNELS];
+    unsigned long             held_fade_end_index[COMPOSITOR_MAX_LAYERS][COMPOSITOR_MAX_CHANNELS];
+    bool                      changed[COMPOSITOR_MAX_LAYERS][COMPOSITOR_MAX_CHANNELS];
+    size_t                    ltp_layer[COMPOSITOR_MAX_CHANNELS];
+    size_t                    winner_layer[COMPOSITOR_MAX_CHANNELS];
+    struct frame_t            merged_frames[COMPOSITOR_MAX_CHANNELS];
+};
+
+void compositor_init(struct compositor_t *compositor,
+                     struct libreorama_ctx *output,
+                     enum compositor_merge_t default_merge);
+
+int compositor_push_layer(struct compositor_t *compositor,
+                          struct libreorama_ctx *ctx,
+                          struct sequence_t sequence,
+                          bool loop);
+
+void compositor_pop_layer(struct compositor_t *compositor);
+
+int compositor_set_merge(struct compositor_t *compositor,
+                         lor_unit_t unit,
+                         lor_channel_t circuit,
+                         enum compositor_merge_t merge);
+
+int compositor_seek(struct compositor_t *compositor,
+                    unsigned long time_ms);
+
+int compositor_frame(struct compositor_t *compositor,
+                     unsigned long time_ms);
+
+#endif //LIBREORAMA_COMPOSITOR_H
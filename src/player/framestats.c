@@ -0,0 +1,59 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "framestats.h"
+
+static const char *FRAME_STATS_METRIC_NAMES[FRAME_STATS_METRIC_COUNT] = {
+        "wake lateness",
+        "minify",
+        "encode",
+        "serial write",
+        "frame bytes",
+};
+
+static const char *FRAME_STATS_METRIC_UNITS[FRAME_STATS_METRIC_COUNT] = {
+        "ns",
+        "ns",
+        "ns",
+        "ns",
+        "bytes",
+};
+
+void frame_stats_reset(struct frame_stats_t *stats) {
+    for (size_t i = 0; i < FRAME_STATS_METRIC_COUNT; i++) {
+        histogram_reset(&stats->histograms[i]);
+    }
+
+    stats->frame_encode_ns = 0;
+}
+
+void frame_stats_print(const struct frame_stats_t *stats,
+                       FILE *file) {
+    fprintf(file, "frame stats:\n");
+
+    for (size_t i = 0; i < FRAME_STATS_METRIC_COUNT; i++) {
+        histogram_print(&stats->histograms[i], FRAME_STATS_METRIC_NAMES[i], FRAME_STATS_METRIC_UNITS[i], file);
+    }
+
+    fflush(file);
+}
@@ -0,0 +1,75 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LIBREORAMA_FRAMESTATS_H
+#define LIBREORAMA_FRAMESTATS_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../histogram.h"
+
+// metrics recorded for each played frame, see #player_play
+enum frame_stats_metric_t {
+    // time between the requested and actual wake of the frame loop
+    FRAME_STATS_WAKE_LATENESS,
+    // change detection and command collection, excluding encoding
+    FRAME_STATS_MINIFY,
+    // encoding of commands (including broadcast dedup) and heartbeats
+    FRAME_STATS_ENCODE,
+    // the frame interrupt, which writes the encode buffer to the serial port
+    FRAME_STATS_SERIAL_WRITE,
+    // bytes written by the frame interrupt
+    FRAME_STATS_BYTES,
+    FRAME_STATS_METRIC_COUNT,
+};
+
+// frame_stats_t is optional, recording is disabled unless ctx->frame_stats is set (see main.c)
+// the same frame_stats_t is shared by a context and its compositor output
+struct frame_stats_t {
+    struct histogram_t histograms[FRAME_STATS_METRIC_COUNT];
+
+    // encode time of the current frame, accumulated by #minify_frame
+    uint64_t frame_encode_ns;
+
+    // set from a signal handler, the frame loop prints the histograms once it is observed
+    volatile sig_atomic_t print_requested;
+};
+
+static inline uint64_t frame_stats_now_ns(void) {
+    struct timespec now;
+
+    // CLOCK_MONOTONIC (rather than _RAW) is serviced without a syscall on most platforms
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+void frame_stats_reset(struct frame_stats_t *stats);
+
+void frame_stats_print(const struct frame_stats_t *stats,
+                       FILE *file);
+
+#endif //LIBREORAMA_FRAMESTATS_H
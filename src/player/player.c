@@ -26,22 +26,27 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../ctx.h"
 #include "../err/al.h"
 #include "../err/lbr.h"
 #include "../lorinterface/encode.h"
+#include "../lorinterface/fadesynth.h"
+#include "../lorinterface/keyframe.h"
 #include "../lorinterface/minify.h"
 #include "../lorinterface/state.h"
 #include "../file.h"
 #include "../interval.h"
+#include "../metrics.h"
+#include "../realtime.h"
+#include "../trace.h"
 #include "../seqtypes/lormedia.h"
+#include "compositor.h"
+#include "framestats.h"
+#include "window.h"
 
-static ALuint       al_source;
-static ALuint       current_al_buffer;
-static unsigned int show_loop_counter;
-static bool         has_al_source;
-static bool         has_al_buffer;
 
-static int player_load_sequence_file(struct sequence_t *current_sequence,
+static int player_load_sequence_file(struct libreorama_ctx *ctx,
+                                     struct sequence_t *current_sequence,
                                      const char *sequence_file,
                                      char **audio_file_hint) {
     // locate a the last dot char in the string, if any
@@ -59,44 +64,118 @@ static int player_load_sequence_file(struct sequence_t *current_sequence,
         return LBR_PLAYER_EUNSUPEXT;
     }
 
+    // a windowed sequence is only decoded as it is played, see window.h
+    // layers are always loaded up front, since the compositor reads each of them at its own frame index
+    const bool windowed = ctx->window_ms > 0 && ctx->compositor == NULL;
+
+    uint64_t trace_start_ns = trace_begin();
+
     int err;
-    if ((err = lormedia_sequence_load(sequence_file, audio_file_hint, current_sequence))) {
-        return err;
+
+    if (windowed) {
+        struct window_source_t source;
+
+        if ((err = lormedia_sequence_open(ctx, sequence_file, audio_file_hint, current_sequence, &source))) {
+            return err;
+        }
+
+        // the window takes ownership of the source, even on error
+        if ((err = window_open(ctx, *current_sequence, source))) {
+            return err;
+        }
+
+        trace_end("lormedia_sequence_open", trace_start_ns);
+    } else {
+        if ((err = lormedia_sequence_load(ctx, sequence_file, audio_file_hint, current_sequence))) {
+            return err;
+        }
+
+        trace_end("lormedia_sequence_load", trace_start_ns);
     }
 
-    if (channel_buffer_index == 0) {
+    if (ctx->channel_buffer_index == 0) {
         return LBR_SEQUENCE_ENOCHANNELS;
     } else if (current_sequence->frame_count == 0) {
         return LBR_SEQUENCE_ENOFRAMES;
     }
 
+    // sort the channels once so each frame can be minified without copying
+    // this must happen before the keyframe index is built since it is indexed by channel
+    trace_start_ns = trace_begin();
+
+    channel_buffer_sort(ctx);
+
+    trace_end("channel_buffer_sort", trace_start_ns);
+
+    // fades are synthesized as each segment is filled, and seeking restores from the source instead of keyframes
+    if (windowed) {
+        return 0;
+    }
+
+    // rewrite brightness ramps into fades, which are interpolated by the hardware
+    // this must also happen before the keyframe index is built, since it modifies frames
+    trace_start_ns = trace_begin();
+
+    if ((err = fadesynth_sequence(ctx, *current_sequence, &current_sequence->synthesized_fade_count))) {
+        return err;
+    }
+
+    trace_end("fadesynth_sequence", trace_start_ns);
+
+    trace_start_ns = trace_begin();
+
+    if ((err = keyframe_index_build(ctx, *current_sequence))) {
+        return err;
+    }
+
+    trace_end("keyframe_index_build", trace_start_ns);
+
     return 0;
 }
 
-static int player_load_audio_file(char *audio_file_hint) {
+static int player_load_audio_file(struct libreorama_ctx *ctx,
+                                  char *audio_file_hint) {
     ALenum al_err;
 
+    // generate the single OpenAL source on first use
+    // this is used for all player playback behavior, and is never needed when rendering
+    if (!ctx->has_al_source) {
+        alGenSources(1, &ctx->al_source);
+
+        if ((al_err = al_get_error()) != AL_NO_ERROR) {
+            al_perror(al_err, "failed to generate OpenAL source");
+            return LBR_ESPERR;
+        }
+
+        // only flag ctx->has_al_source as true if initialized without error
+        ctx->has_al_source = true;
+    }
+
     // if an AL buffer is already initialized, unload it first
-    if (has_al_buffer) {
-        has_al_buffer = false;
+    if (ctx->has_al_buffer) {
+        ctx->has_al_buffer = false;
 
         // unqueue the buffer from the active source
         // otherwise the delete will fail since it is considered in use
-        alSourceUnqueueBuffers(al_source, 1, &current_al_buffer);
+        alSourceUnqueueBuffers(ctx->al_source, 1, &ctx->current_al_buffer);
         if ((al_err = al_get_error()) != AL_NO_ERROR) {
             al_perror(al_err, "failed to unqueue previous player buffer from source");
             return LBR_ESPERR;
         }
 
         // delete the buffer, freeing the memory
-        alDeleteBuffers(1, &current_al_buffer);
+        alDeleteBuffers(1, &ctx->current_al_buffer);
         if ((al_err = al_get_error()) != AL_NO_ERROR) {
             al_perror(al_err, "failed to delete previous player buffer");
             return LBR_ESPERR;
         }
     }
 
-    current_al_buffer = alutCreateBufferFromFile(audio_file_hint);
+    const uint64_t trace_start_ns = trace_begin();
+
+    ctx->current_al_buffer = alutCreateBufferFromFile(audio_file_hint);
+
+    trace_end("audio_decode", trace_start_ns);
 
     // test for buffering errors
     if ((al_err = al_get_error()) != AL_NO_ERROR) {
@@ -104,13 +183,13 @@ static int player_load_audio_file(char *audio_file_hint) {
         return LBR_ESPERR;
     }
 
-    // only flag has_al_buffer as true if #al_get_error returns ok
-    // otherwise the current_al_buffer value may be invalid but flagged as set
-    has_al_buffer = true;
+    // only flag ctx->has_al_buffer as true if #al_get_error returns ok
+    // otherwise the ctx->current_al_buffer value may be invalid but flagged as set
+    ctx->has_al_buffer = true;
 
     // assign the OpenAL to the source
     // this enables #player_start to simply play the source to start
-    alSourcei(al_source, AL_BUFFER, current_al_buffer);
+    alSourcei(ctx->al_source, AL_BUFFER, ctx->current_al_buffer);
 
     if ((al_err = al_get_error()) != AL_NO_ERROR) {
         al_perror(al_err, "failed to assign OpenAL source buffer");
@@ -120,32 +199,192 @@ static int player_load_audio_file(char *audio_file_hint) {
     return 0;
 }
 
-static int player_reset_encode_buffer(player_frame_interrupt_t frame_interrupt,
+static int player_reset_encode_buffer(struct libreorama_ctx *ctx,
+                                      player_frame_interrupt_t frame_interrupt,
                                       unsigned short step_time_ms) {
     int err;
-    if ((err = encode_reset_frame())) {
+    if ((err = encode_reset_frame(ctx))) {
         return err;
     }
-    if ((err = frame_interrupt(step_time_ms))) {
+    if ((err = frame_interrupt(ctx, step_time_ms))) {
         return err;
     }
     return 0;
 }
 
-int player_init(struct player_t *player,
-                const char *show_file_path) {
-    // generate the single OpenAL source
-    // this is used for all player playback behavior
-    alGenSources(1, &al_source);
+// the compositor's output context minifies & encodes on behalf of the resident sequence, if any
+static struct libreorama_ctx *player_output(struct libreorama_ctx *ctx) {
+    return ctx->compositor != NULL ? ctx->compositor->output : ctx;
+}
 
-    ALenum err;
-    if ((err = al_get_error()) != AL_NO_ERROR) {
-        al_perror(err, "failed to generate OpenAL source");
-        return LBR_ESPERR;
+// without a resident sequence the output has no encode buffer, a single channel reservation provides one
+static int player_reserve_output(struct libreorama_ctx *output) {
+    if (output->encode_buffer != NULL) {
+        return 0;
+    }
+
+    return channel_buffer_reserve(output, 1);
+}
+
+static void player_carry_free(struct libreorama_ctx *ctx) {
+    free(ctx->output_carry);
+
+    // release any dangling pointers and avoid double free
+    ctx->output_carry       = NULL;
+    ctx->output_carry_count = 0;
+}
+
+// records the last sent frame of each set channel of the output
+// channels are sorted, so the carried channels are grouped by unit
+static int player_carry_save(struct libreorama_ctx *ctx,
+                             const struct libreorama_ctx *output) {
+    player_carry_free(ctx);
+
+    size_t count = 0;
+
+    for (size_t i = 0; i < output->channel_buffer_index; i++) {
+        if (frame_is_set(output->output_state[i].last_sent_frame)) {
+            count++;
+        }
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    if ((ctx->output_carry = malloc(sizeof(struct player_carry_t) * count)) == NULL) {
+        return LBR_EERRNO;
+    }
+
+    for (size_t i = 0; i < output->channel_buffer_index; i++) {
+        if (frame_is_set(output->output_state[i].last_sent_frame)) {
+            ctx->output_carry[ctx->output_carry_count++] = (struct player_carry_t) {
+                    .unit = output->channel_buffer[i].unit,
+                    .circuit = output->channel_buffer[i].circuit,
+                    .frame = output->output_state[i].last_sent_frame,
+            };
+        }
+    }
+
+    return 0;
+}
+
+// applies the carried state to the output, whose channels may belong to a different sequence
+// carried channels which the output no longer includes are turned off, since no later frame will reach them
+static int player_carry_restore(struct libreorama_ctx *ctx,
+                                struct libreorama_ctx *output,
+                                player_frame_interrupt_t frame_interrupt,
+                                unsigned short step_time_ms) {
+    static const struct frame_t off_frame = {
+            .action = LOR_ACTION_CHANNEL_SET_BRIGHTNESS,
+            .set_brightness = 0,
+    };
+
+    int err = 0;
+
+    for (size_t i = 0; i < ctx->output_carry_count && !err; i++) {
+        const struct player_carry_t carry = ctx->output_carry[i];
+
+        // dropped channels may outnumber the output's channels, which the encode buffer is sized by
+        if (output->encode_buffer_capacity - output->encode_buffer_index < ENCODE_FRAME_MAX_LENGTH && (err = frame_interrupt(output, step_time_ms))) {
+            break;
+        }
+
+        const size_t output_index = channel_buffer_find(output, carry.unit, carry.circuit);
+
+        if (output_index != CHANNEL_BUFFER_NOT_FOUND) {
+            // fades continue within the hardware, so their current brightness is unknown
+            // they are left unset, which ensures the channel's next frame is always sent
+            if (carry.frame.action != LOR_ACTION_CHANNEL_FADE) {
+                output->output_state[output_index].last_sent_frame   = carry.frame;
+                output->output_state[output_index].last_sent_palette = FRAME_PALETTE_NONE;
+            }
+        } else if (output->channel_units[carry.unit].count == 0) {
+            // a unit without any output channels is turned off by a single unit action
+            if (i == 0 || ctx->output_carry[i - 1].unit != carry.unit) {
+                err = encode_unit_off_frame(output, carry.unit);
+            }
+        } else {
+            err = encode_frame(output, carry.unit, LOR_CHANNEL_ID, carry.circuit, 0, off_frame);
+        }
+    }
+
+    player_carry_free(ctx);
+
+    if (err) {
+        return err;
+    }
+
+    // the carried state takes the place of the reset frame, and is written in its place
+    return frame_interrupt(output, step_time_ms);
+}
+
+static int player_seek(struct libreorama_ctx *ctx,
+                       struct libreorama_ctx *output,
+                       player_frame_interrupt_t frame_interrupt,
+                       struct sequence_t sequence,
+                       frame_index_t frame_index) {
+    int err;
+
+    if (ctx->compositor != NULL) {
+        // the compositor restores and merges the state of each of its layers
+        if ((err = compositor_seek(ctx->compositor, (unsigned long) frame_index * sequence.step_time_ms))) {
+            return err;
+        }
+    } else {
+        // restore the channel state as of frame_index from the keyframe index
+        // this ensures effects started prior to frame_index (such as fades) are still output
+        const struct frame_t *frames = NULL;
+
+        if (ctx->window != NULL) {
+            err = window_restore(ctx, frame_index, &frames);
+        } else {
+            err = keyframe_restore(ctx, sequence, frame_index, &frames);
+        }
+
+        if (err) {
+            return err;
+        }
+
+        // write the restored state as a single minimized burst
+        if ((err = minify_sync_frames(ctx, frames))) {
+            return err;
+        }
+    }
+
+    if ((err = frame_interrupt(output, sequence.step_time_ms))) {
+        return err;
+    }
+    return 0;
+}
+
+static int player_minify_frame(struct libreorama_ctx *ctx,
+                               struct sequence_t sequence,
+                               frame_index_t frame_index) {
+    if (ctx->compositor != NULL) {
+        return compositor_frame(ctx->compositor, (unsigned long) frame_index * sequence.step_time_ms);
     }
 
-    // only flag has_al_source as true if initialized without error
-    has_al_source = true;
+    // a windowed sequence's timelines are pointed at the segment of frame_index before they are read
+    int err;
+    if (ctx->window != NULL && (err = window_advance(ctx, frame_index))) {
+        return err;
+    }
+
+    return minify_frame(ctx, sequence, frame_index);
+}
+
+int player_init(struct libreorama_ctx *ctx,
+                struct player_t *player,
+                const char *show_file_path) {
+    // OpenAL objects are created on first use by #player_load_audio_file
+    (void) ctx;
+
+    // a NULL show_file_path indicates sequences are provided by the caller (see daemon.h)
+    if (show_file_path == NULL) {
+        player->show_file = NULL;
+        return 0;
+    }
 
     // open the show file for reading
     player->show_file = fopen(show_file_path, "rb");
@@ -168,20 +407,21 @@ int player_init(struct player_t *player,
     return 0;
 }
 
-int player_next_sequence(struct player_t *player,
+int player_next_sequence(struct libreorama_ctx *ctx,
+                         struct player_t *player,
                          char **next_sequence) {
     int err;
-    if ((err = file_read_line(player->show_file, next_sequence))) {
+    if ((err = file_read_line(ctx, player->show_file, next_sequence))) {
         if (!feof(player->show_file)) {
             return err;
         }
 
         // if the stream hit EOF, rewind according to player configuration
-        if (player->show_loop_count == -1 || ++(show_loop_counter) < player->show_loop_count) {
+        if (player->show_loop_count == -1 || ++(player->show_loop_counter) < player->show_loop_count) {
             rewind(player->show_file);
 
             // re-fire #player_next_sequence to ensure the next read's error (if any) is returned
-            return player_next_sequence(player, next_sequence);
+            return player_next_sequence(ctx, player, next_sequence);
         }
 
         // end of show!
@@ -192,22 +432,33 @@ int player_next_sequence(struct player_t *player,
     return 0;
 }
 
-int player_start(player_frame_interrupt_t frame_interrupt,
-                 unsigned short time_correction_ms,
-                 char *sequence_file_path) {
-    // ready the current_sequence value for loading
+static int player_load(struct libreorama_ctx *ctx,
+                       const char *sequence_file_path,
+                       bool load_audio) {
+    // the most recently played sequence, and its audio buffer, are kept resident
+    // replaying it (such as a looping show or a re-queued daemon sequence) skips loading entirely
+    if (ctx->resident_sequence_file != NULL && strcmp(ctx->resident_sequence_file, sequence_file_path) == 0) {
+        return 0;
+    }
+
+    // release the previously resident sequence, if any
+    libreorama_ctx_free(ctx);
+
+    // ready the ctx->resident_sequence value for loading
     // pass a step_time_ms default value of 50ms (20 FPS)
     // this provides a minimum step time for the program
-    struct sequence_t current_sequence = (struct sequence_t) {
+    ctx->resident_sequence = (struct sequence_t) {
             .step_time_ms = 50,
     };
 
+    const uint64_t load_start_ns = frame_stats_now_ns();
+
     // load the sequence file into memory
     // this will buffer the initial data, and remainder is streamed during updates
     char *audio_file_hint = NULL;
 
     int err;
-    if ((err = player_load_sequence_file(&current_sequence, sequence_file_path, &audio_file_hint))) {
+    if ((err = player_load_sequence_file(ctx, &ctx->resident_sequence, sequence_file_path, &audio_file_hint))) {
         // ensure the allocated audio_file_hint buf is freed
         free(audio_file_hint);
         return err;
@@ -215,23 +466,181 @@ int player_start(player_frame_interrupt_t frame_interrupt,
 
     printf("sequence_file: %s\n", sequence_file_path);
     printf("audio_file_hint: %s\n", audio_file_hint);
-    printf("step_time_ms: %dms (%d FPS)\n", current_sequence.step_time_ms, 1000 / current_sequence.step_time_ms);
-    printf("frame_count: %d\n", current_sequence.frame_count);
-    printf("channels_count: %zu\n", channel_buffer_index);
+    printf("step_time_ms: %dms (%d FPS)\n", ctx->resident_sequence.step_time_ms, 1000 / ctx->resident_sequence.step_time_ms);
+    printf("frame_count: %u\n", ctx->resident_sequence.frame_count);
+    printf("effect_count: %lu\n", ctx->resident_sequence.effect_count);
+    printf("synthesized_fade_count: %lu\n", ctx->resident_sequence.synthesized_fade_count);
+    printf("channels_count: %zu\n", ctx->channel_buffer_index);
 
     // attempt to load audio file provided by determined sequence type
     // this will delegate or fallback internally as needed
-    if ((err = player_load_audio_file(audio_file_hint))) {
+    // rendering does not use OpenAL, and skips decoding the audio entirely
+    const uint64_t audio_decode_start_ns = frame_stats_now_ns();
+
+    if (load_audio) {
+        err = player_load_audio_file(ctx, audio_file_hint);
+    }
+
+    free(audio_file_hint);
+
+    if (err) {
+        return err;
+    }
+
+    if (ctx->metrics != NULL) {
+        const uint64_t load_end_ns = frame_stats_now_ns();
+
+        metrics_set_load_time(ctx->metrics, (unsigned long) ((load_end_ns - load_start_ns) / 1000u), (unsigned long) ((load_end_ns - audio_decode_start_ns) / 1000u));
+    }
+
+    // only mark the sequence as resident once fully loaded
+    // a partial load is discarded by the next #player_load call
+    if ((ctx->resident_sequence_file = strdup(sequence_file_path)) == NULL) {
+        return LBR_EERRNO;
+    }
+
+    return 0;
+}
+
+void player_stop(struct libreorama_ctx *ctx) {
+    ctx->stop_requested = true;
+}
+
+int player_reset(struct libreorama_ctx *ctx,
+                 player_frame_interrupt_t frame_interrupt) {
+    struct libreorama_ctx *output = player_output(ctx);
+
+    player_carry_free(ctx);
+
+    int err;
+    if ((err = player_reserve_output(output))) {
+        return err;
+    }
+    if ((err = player_reset_encode_buffer(output, frame_interrupt, ENCODE_HEARTBEAT_INTERVAL_MS))) {
+        return err;
+    }
+
+    channel_output_state_reset(output);
+
+    return 0;
+}
+
+int player_idle(struct libreorama_ctx *ctx,
+                player_frame_interrupt_t frame_interrupt) {
+    struct libreorama_ctx *output = player_output(ctx);
+
+    int err;
+    if ((err = player_reserve_output(output))) {
+        return err;
+    }
+
+    // the first frame of any interval always carries a heartbeat
+    if ((err = encode_heartbeat_frame(output, 0, ENCODE_HEARTBEAT_INTERVAL_MS))) {
         return err;
     }
 
+    return frame_interrupt(output, ENCODE_HEARTBEAT_INTERVAL_MS);
+}
+
+int player_load_layer(struct libreorama_ctx *ctx,
+                      const char *sequence_file_path,
+                      struct sequence_t *sequence) {
+    *sequence = (struct sequence_t) {
+            .step_time_ms = 50,
+    };
+
+    // layers are played without audio, the audio_file_hint is discarded
+    char *audio_file_hint = NULL;
+
+    const int err = player_load_sequence_file(ctx, sequence, sequence_file_path, &audio_file_hint);
+
     free(audio_file_hint);
 
+    return err;
+}
+
+static uint64_t player_stats_now_ns(const struct frame_stats_t *stats) {
+    return stats != NULL ? frame_stats_now_ns() : 0;
+}
+
+static void player_record_frame_stats(struct frame_stats_t *stats,
+                                      const struct interval_t *interval_timer,
+                                      uint64_t minify_start_ns,
+                                      uint64_t heartbeat_start_ns,
+                                      uint64_t write_start_ns,
+                                      uint64_t write_end_ns,
+                                      size_t frame_bytes) {
+    const long long lateness_ns = interval_lateness_ns(interval_timer);
+
+    // encoding happens within #player_minify_frame, its time is accumulated separately by #minify_frame
+    const uint64_t encode_ns = stats->frame_encode_ns + (write_start_ns - heartbeat_start_ns);
+    const uint64_t minify_ns = (heartbeat_start_ns - minify_start_ns) - stats->frame_encode_ns;
+
+    histogram_record(&stats->histograms[FRAME_STATS_WAKE_LATENESS], lateness_ns > 0 ? (uint64_t) lateness_ns : 0);
+    histogram_record(&stats->histograms[FRAME_STATS_MINIFY], minify_ns);
+    histogram_record(&stats->histograms[FRAME_STATS_ENCODE], encode_ns);
+    histogram_record(&stats->histograms[FRAME_STATS_SERIAL_WRITE], write_end_ns - write_start_ns);
+    histogram_record(&stats->histograms[FRAME_STATS_BYTES], frame_bytes);
+
+    stats->frame_encode_ns = 0;
+}
+
+static void player_sample_audio_drift(struct libreorama_ctx *ctx,
+                                      struct sequence_t sequence,
+                                      frame_index_t frame_index,
+                                      unsigned short time_correction_ms) {
+    ALfloat audio_offset_s;
+
+    alGetSourcef(ctx->al_source, AL_SEC_OFFSET, &audio_offset_s);
+
+    if (al_get_error() != AL_NO_ERROR) {
+        return;
+    }
+
+    // playback starts time_correction_ms into the sequence, while the audio starts at 0
+    const long sequence_offset_us = ((long) frame_index * sequence.step_time_ms - time_correction_ms) * 1000;
+
+    metrics_set_audio_drift(ctx->metrics, (long) (audio_offset_s * 1000000.0f) - sequence_offset_us);
+}
+
+static int player_play(struct libreorama_ctx *ctx,
+                       struct libreorama_ctx *output,
+                       player_frame_interrupt_t frame_interrupt,
+                       unsigned short time_correction_ms) {
+    const struct sequence_t current_sequence = ctx->resident_sequence;
+
+    ctx->stop_requested = false;
+
     printf("playing...\n");
 
+    // touch every buffer used by playback ahead of time
+    // this avoids page faults (and the resulting stutter) during the first frames
+    if (ctx->realtime_prefault) {
+        const uint64_t trace_start_ns = trace_begin();
+
+        realtime_prefault_ctx(ctx);
+
+        trace_end("realtime_prefault_ctx", trace_start_ns);
+    }
+
+    int err;
+
+    // fill the window's segment of the initial frame_index (see below) before the audio starts
+    if (ctx->window != NULL && (err = window_start(ctx, (frame_index_t) (time_correction_ms / current_sequence.step_time_ms)))) {
+        return err;
+    }
+
+    // write any spans recorded while loading before playback begins
+    trace_flush();
+
+    if (ctx->metrics != NULL) {
+        metrics_set_sequence(ctx->metrics, ctx->resident_sequence_file);
+        metrics_set_playing(ctx->metrics, true);
+    }
+
     // notify OpenAL to start source playback
     // OpenAL will automatically stop playback at EOF
-    alSourcePlay(al_source);
+    alSourcePlay(ctx->al_source);
 
     ALenum al_err;
     if ((al_err = al_get_error()) != AL_NO_ERROR) {
@@ -260,36 +669,119 @@ int player_start(player_frame_interrupt_t frame_interrupt,
 
     // reset the initial output state
     // otherwise channels may still be active when initially booted
-    if ((err = player_reset_encode_buffer(frame_interrupt, current_sequence.step_time_ms))) {
+    // persistent output instead resumes from the state carried from the previous sequence
+    if (ctx->output_persist) {
+        err = player_carry_restore(ctx, output, frame_interrupt, current_sequence.step_time_ms);
+    } else {
+        err = player_reset_encode_buffer(output, frame_interrupt, current_sequence.step_time_ms);
+    }
+
+    if (err) {
         return err;
     }
 
+    if (frame_index > 0) {
+        if ((err = player_seek(ctx, output, frame_interrupt, current_sequence, frame_index))) {
+            return err;
+        }
+    }
+
+    // optional, each sequence records its own frame stats
+    struct frame_stats_t *stats = ctx->frame_stats;
+
+    if (stats != NULL) {
+        frame_stats_reset(stats);
+    }
+
     while (true) {
+        // each stage of the frame is traced within a "frame" span
+        const uint64_t trace_frame_start_ns = trace_begin();
+
+        uint64_t trace_start_ns = trace_frame_start_ns;
+
         if ((err = interval_wake(&interval_timer))) {
             return err;
         }
 
+        trace_end("interval_wake", trace_start_ns);
+
+        const uint64_t minify_start_ns = player_stats_now_ns(stats);
+
+        trace_start_ns = trace_begin();
+
         // write the current frame index into the frame_buf
         // pass an interrupt call back to the parent
-        if ((err = minify_frame(current_sequence, frame_index))) {
+        if ((err = player_minify_frame(ctx, current_sequence, frame_index))) {
             return err;
         }
 
-        if ((err = encode_heartbeat_frame(frame_index, current_sequence.step_time_ms))) {
+        trace_end("minify_frame", trace_start_ns);
+
+        const uint64_t heartbeat_start_ns = player_stats_now_ns(stats);
+
+        trace_start_ns = trace_begin();
+
+        if ((err = encode_heartbeat_frame(output, frame_index, current_sequence.step_time_ms))) {
             return err;
         }
 
-        if ((err = frame_interrupt(current_sequence.step_time_ms))) {
+        trace_end("encode_heartbeat_frame", trace_start_ns);
+
+        // frame_interrupt resets the encode buffer, capture its length first
+        const size_t   frame_bytes    = output->encode_buffer_index;
+        const uint64_t write_start_ns = player_stats_now_ns(stats);
+
+        trace_start_ns = trace_begin();
+
+        if ((err = frame_interrupt(output, current_sequence.step_time_ms))) {
             return err;
         }
 
+        trace_end_arg("frame_interrupt", trace_start_ns, (long) frame_bytes);
+
+        // a frame is late once its wake overran by half of its step time
+        if (ctx->metrics != NULL) {
+            metrics_record_frame(ctx->metrics, frame_index, frame_bytes, interval_lateness_ns(&interval_timer) > (long long) current_sequence.step_time_ms * 500000);
+        }
+
+        if (stats != NULL) {
+            player_record_frame_stats(stats, &interval_timer, minify_start_ns, heartbeat_start_ns, write_start_ns, frame_stats_now_ns(), frame_bytes);
+
+            // print_requested is set by a signal handler (see main.c)
+            if (stats->print_requested) {
+                stats->print_requested = 0;
+
+                frame_stats_print(stats, stdout);
+            }
+        }
+
         // move to next frame for next iteration
         frame_index++;
 
+        // #player_stop may be called by frame_interrupt
+        // halt the audio early and handle it as the end of playback
+        if (ctx->stop_requested) {
+            alSourceStop(ctx->al_source);
+            break;
+        }
+
         // test if playback is still happening
         // this defers to the audio time rather than the sequence
         // this helps ensure a consistent result
-        alGetSourcei(al_source, AL_SOURCE_STATE, &source_state);
+        trace_start_ns = trace_begin();
+
+        alGetSourcei(ctx->al_source, AL_SOURCE_STATE, &source_state);
+
+        trace_end("al_source_state", trace_start_ns);
+
+        // sample the audio drift once per second, this is an OpenAL call and is not free
+        // frame_index has already advanced, the frame just played is compared against the audio
+        if (ctx->metrics != NULL && frame_index % (1000 / current_sequence.step_time_ms) == 0) {
+            player_sample_audio_drift(ctx, current_sequence, (frame_index_t) (frame_index - 1), time_correction_ms);
+        }
+
+        // the frame index is decremented since it was advanced for the next iteration
+        trace_end_arg("frame", trace_frame_start_ns, (long) frame_index - 1);
 
         if ((al_err = al_get_error()) != AL_NO_ERROR) {
             al_perror(al_err, "failed to get player source state");
@@ -301,46 +793,192 @@ int player_start(player_frame_interrupt_t frame_interrupt,
             break;
         }
 
+        trace_start_ns = trace_begin();
+
         // sleep after each loop iteration
         // interval internally manages time spent to ensure
         //  that each sleep maintains the expected step_time normal
         if ((err = interval_sleep(&interval_timer))) {
             return err;
         }
+
+        trace_end("interval_sleep", trace_start_ns);
+    }
+
+    trace_flush();
+
+    if (stats != NULL) {
+        frame_stats_print(stats, stdout);
+    }
+
+    if (ctx->window != NULL) {
+        printf("window underruns: %lu\n", ctx->window->underrun_count);
+    }
+
+    if (ctx->metrics != NULL) {
+        metrics_set_playing(ctx->metrics, false);
+    }
+
+    // persistent output is left as is, the next sequence resumes from the carried state
+    if (ctx->output_persist) {
+        return player_carry_save(ctx, output);
     }
 
     // encode a reset frame and trigger a final interrupt
     // this resets any active light output states
-    if ((err = player_reset_encode_buffer(frame_interrupt, current_sequence.step_time_ms))) {
+    if ((err = player_reset_encode_buffer(output, frame_interrupt, current_sequence.step_time_ms))) {
         return err;
     }
 
-    channel_buffer_reset();
-    channel_output_state_reset();
-    frame_buffer_free();
+    // the sequence remains resident for replays, only the output state is reset
+    // this matches the reset frame which has turned off all channels
+    channel_output_state_reset(output);
 
     return 0;
 }
 
-void player_free(const struct player_t *player) {
+int player_start(struct libreorama_ctx *ctx,
+                 player_frame_interrupt_t frame_interrupt,
+                 unsigned short time_correction_ms,
+                 char *sequence_file_path) {
+    int err;
+    if ((err = player_load(ctx, sequence_file_path, true))) {
+        return err;
+    }
+
+    // without a compositor, the context minifies & encodes its own sequence
+    // the window's worker, if any, is stopped once playback ends (or fails)
+    if (ctx->compositor == NULL) {
+        err = player_play(ctx, ctx, frame_interrupt, time_correction_ms);
+
+        window_stop(ctx);
+
+        return err;
+    }
+
+    // otherwise the resident sequence is pushed as the top compositor layer
+    // all output is minified & encoded by the compositor's output context
+    if ((err = compositor_push_layer(ctx->compositor, ctx, ctx->resident_sequence, false))) {
+        return err;
+    }
+
+    err = player_play(ctx, ctx->compositor->output, frame_interrupt, time_correction_ms);
+
+    compositor_pop_layer(ctx->compositor);
+
+    return err;
+}
+
+static int player_render_frames(struct libreorama_ctx *ctx,
+                                struct libreorama_ctx *output,
+                                player_frame_interrupt_t frame_interrupt) {
+    const struct sequence_t current_sequence = ctx->resident_sequence;
+
+    struct timespec start_time;
+    struct timespec stop_time;
+
+    unsigned long long frame_ns_total = 0;
+    unsigned long long frame_ns_max   = 0;
+
+    int err;
+    if (ctx->window != NULL && (err = window_start(ctx, 0))) {
+        return err;
+    }
+
+    if ((err = player_reset_encode_buffer(output, frame_interrupt, current_sequence.step_time_ms))) {
+        return err;
+    }
+
+    // without audio, the sequence's own frame_count determines the playback length
+    // frames are rendered back to back without sleeping
+    for (frame_index_t frame_index = 0; frame_index < current_sequence.frame_count; frame_index++) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &start_time);
+
+        if ((err = player_minify_frame(ctx, current_sequence, frame_index))) {
+            return err;
+        }
+
+        if ((err = encode_heartbeat_frame(output, frame_index, current_sequence.step_time_ms))) {
+            return err;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC_RAW, &stop_time);
+
+        // only time the minify/encode work, the interrupt is excluded
+        const unsigned long long frame_ns = (unsigned long long) (stop_time.tv_sec - start_time.tv_sec) * 1000000000ull + (unsigned long long) (stop_time.tv_nsec - start_time.tv_nsec);
+
+        frame_ns_total += frame_ns;
+
+        if (frame_ns > frame_ns_max) {
+            frame_ns_max = frame_ns;
+        }
+
+        if ((err = frame_interrupt(output, current_sequence.step_time_ms))) {
+            return err;
+        }
+    }
+
+    if ((err = player_reset_encode_buffer(output, frame_interrupt, current_sequence.step_time_ms))) {
+        return err;
+    }
+
+    channel_output_state_reset(output);
+
+    printf("rendered frames: %u\n", current_sequence.frame_count);
+    printf("minify/encode ns per frame: %llu avg, %llu max\n", frame_ns_total / current_sequence.frame_count, frame_ns_max);
+
+    return 0;
+}
+
+int player_render(struct libreorama_ctx *ctx,
+                  player_frame_interrupt_t frame_interrupt,
+                  char *sequence_file_path) {
+    int err;
+    if ((err = player_load(ctx, sequence_file_path, false))) {
+        return err;
+    }
+
+    if (ctx->compositor == NULL) {
+        err = player_render_frames(ctx, ctx, frame_interrupt);
+
+        window_stop(ctx);
+
+        return err;
+    }
+
+    if ((err = compositor_push_layer(ctx->compositor, ctx, ctx->resident_sequence, false))) {
+        return err;
+    }
+
+    err = player_render_frames(ctx, ctx->compositor->output, frame_interrupt);
+
+    compositor_pop_layer(ctx->compositor);
+
+    return err;
+}
+
+void player_free(struct libreorama_ctx *ctx,
+                 const struct player_t *player) {
     if (player->show_file != NULL) {
         fclose(player->show_file);
     }
 
+    player_carry_free(ctx);
+
     ALenum err;
 
     // test the source & buffer fields of player for initialization
     // delete each if set
-    if (has_al_buffer) {
-        alDeleteBuffers(1, &current_al_buffer);
+    if (ctx->has_al_buffer) {
+        alDeleteBuffers(1, &ctx->current_al_buffer);
 
         if ((err = al_get_error()) != AL_NO_ERROR) {
             al_perror(err, "failed to delete current OpenAL buffer");
         }
     }
 
-    if (has_al_source) {
-        alDeleteSources(1, &al_source);
+    if (ctx->has_al_source) {
+        alDeleteSources(1, &ctx->al_source);
 
         if ((err = al_get_error()) != AL_NO_ERROR) {
             al_perror(err, "failed to delete OpenAL source");
@@ -30,22 +30,55 @@
 #include "sequence.h"
 
 struct player_t {
-    FILE *show_file;
-    int  show_loop_count;
+    FILE         *show_file;
+    int          show_loop_count;
+    unsigned int show_loop_counter;
 };
 
-typedef int (*player_frame_interrupt_t)(unsigned short step_time_ms);
+// the last sent frame of a channel, carried between sequences when ctx->output_persist is set
+struct player_carry_t {
+    lor_unit_t     unit;
+    lor_channel_t  circuit;
+    struct frame_t frame;
+};
+
+struct libreorama_ctx;
 
-int player_init(struct player_t *player,
+typedef int (*player_frame_interrupt_t)(struct libreorama_ctx *ctx,
+                                        unsigned short step_time_ms);
+
+int player_init(struct libreorama_ctx *ctx,
+                struct player_t *player,
                 const char *show_file_path);
 
-int player_next_sequence(struct player_t *player,
+int player_next_sequence(struct libreorama_ctx *ctx,
+                         struct player_t *player,
                          char **next_sequence);
 
-int player_start(player_frame_interrupt_t frame_interrupt,
+int player_load_layer(struct libreorama_ctx *ctx,
+                      const char *sequence_file_path,
+                      struct sequence_t *sequence);
+
+int player_start(struct libreorama_ctx *ctx,
+                 player_frame_interrupt_t frame_interrupt,
                  unsigned short time_correction_ms,
                  char *sequence_file_path);
 
-void player_free(const struct player_t *player);
+int player_render(struct libreorama_ctx *ctx,
+                  player_frame_interrupt_t frame_interrupt,
+                  char *sequence_file_path);
+
+void player_stop(struct libreorama_ctx *ctx);
+
+// resets every channel of the output and forgets any carried state
+int player_reset(struct libreorama_ctx *ctx,
+                 player_frame_interrupt_t frame_interrupt);
+
+// writes a heartbeat, keeping controllers under network control between sequences
+int player_idle(struct libreorama_ctx *ctx,
+                player_frame_interrupt_t frame_interrupt);
+
+void player_free(struct libreorama_ctx *ctx,
+                 const struct player_t *player);
 
 #endif //LIBREORAMA_PLAYER_H
@@ -32,6 +32,8 @@
 struct sequence_t {
     unsigned short step_time_ms;
     frame_index_t  frame_count;
+    unsigned long  effect_count;
+    unsigned long  synthesized_fade_count;
 };
 
 #endif //LIBREORAMA_SEQUENCE_H
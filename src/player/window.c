@@ -0,0 +1,361 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "window.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../ctx.h"
+#include "../err/lbr.h"
+#include "../lorinterface/fadesynth.h"
+#include "../trace.h"
+
+static frame_index_t window_segment_length(const struct window_t *window,
+                                           frame_index_t segment) {
+    if (segment >= window->segment_count) {
+        return 0;
+    }
+
+    const frame_index_t start = segment * window->segment_frame_count;
+
+    // the final segment is truncated by the end of the sequence
+    return window->sequence.frame_count - start < window->segment_frame_count ? window->sequence.frame_count - start : window->segment_frame_count;
+}
+
+int window_open(struct libreorama_ctx *ctx,
+                struct sequence_t sequence,
+                struct window_source_t source) {
+    window_free(ctx);
+
+    int return_code = 0;
+
+    struct window_t *window = calloc(1, sizeof(struct window_t));
+
+    if (window == NULL) {
+        return_code = LBR_EERRNO;
+        goto window_open_free;
+    }
+
+    // the window spans window_ms of frames, split across its segments
+    // each segment must be addressable by a single frame arena request
+    unsigned long long segment_frame_count = (unsigned long long) ctx->window_ms / sequence.step_time_ms / WINDOW_SEGMENT_COUNT;
+
+    if (segment_frame_count > sequence.frame_count) {
+        segment_frame_count = sequence.frame_count;
+    }
+
+    if (ctx->channel_buffer_index > 0 && segment_frame_count * ctx->channel_buffer_index > FRAME_INDEX_MAX) {
+        segment_frame_count = FRAME_INDEX_MAX / ctx->channel_buffer_index;
+    }
+
+    if (segment_frame_count == 0) {
+        segment_frame_count = 1;
+    }
+
+    window->source              = source;
+    window->sequence            = sequence;
+    window->segment_frame_count = (frame_index_t) segment_frame_count;
+    window->segment_count       = (frame_index_t) ((sequence.frame_count + segment_frame_count - 1) / segment_frame_count);
+    window->ctx                 = ctx;
+
+    int err;
+
+    // slots hold wide indexes, since the palette may exceed FRAME_PALETTE_NARROW_MAX before a segment is filled
+    // requests are aligned for wide indexes (see FRAME_BLOCK_REQUEST_ALIGNMENT)
+    for (size_t i = 0; i < WINDOW_SEGMENT_COUNT; i++) {
+        frame_word_t *words;
+
+        if ((err = frame_buffer_request(ctx, (size_t) window->segment_frame_count * ctx->channel_buffer_index * (sizeof(frame_palette_index_t) / sizeof(frame_word_t)), &words))) {
+            return_code = err;
+            goto window_open_free;
+        }
+
+        window->slots[i] = (frame_palette_index_t *) words;
+    }
+
+    // the worker interns the frames of each segment while the player reads previously interned frames
+    // each effect interns at most a single frame, and each synthesized fade replaces at least FADESYNTH_MIN_SAMPLES of them
+    // so the palette is reserved for every frame the sequence could intern, and is never moved
+    if ((err = frame_palette_reserve(ctx, 1 + sequence.effect_count + sequence.effect_count / FADESYNTH_MIN_SAMPLES))) {
+        return_code = err;
+        goto window_open_free;
+    }
+
+    pthread_mutex_init(&window->lock, NULL);
+    pthread_cond_init(&window->cond, NULL);
+
+    ctx->window = window;
+
+    return 0;
+
+    window_open_free:
+    source.free(source.data);
+    free(window);
+
+    return return_code;
+}
+
+static int window_fill(struct libreorama_ctx *ctx,
+                       struct window_t *window,
+                       frame_index_t segment) {
+    const uint64_t trace_start_ns = trace_begin();
+
+    const frame_index_t   count = window_segment_length(window, segment);
+    frame_palette_index_t *slot = window->slots[segment % WINDOW_SEGMENT_COUNT];
+
+    memset(slot, 0, sizeof(frame_palette_index_t) * count * ctx->channel_buffer_index);
+
+    int err;
+    if ((err = window->source.fill(ctx, window->source.data, window->sequence, segment * window->segment_frame_count, count, slot))) {
+        return err;
+    }
+
+    // ramps are rewritten into fades as by #fadesynth_sequence, although only within the segment
+    struct sequence_t segment_sequence = window->sequence;
+
+    segment_sequence.frame_count = count;
+
+    for (size_t i = 0; i < ctx->channel_buffer_index; i++) {
+        if ((err = fadesynth_frames(ctx, &slot[i * count], segment_sequence, &window->synthesized_fade_count))) {
+            return err;
+        }
+    }
+
+    trace_end_arg("window_fill", trace_start_ns, (long) segment);
+
+    return 0;
+}
+
+static void window_point_timelines(struct libreorama_ctx *ctx,
+                                   const struct window_t *window,
+                                   frame_index_t segment) {
+    // segments past the end of the sequence (while the audio is still playing) are empty
+    const frame_index_t   count = window_segment_length(window, segment);
+    frame_palette_index_t *slot = window->slots[segment % WINDOW_SEGMENT_COUNT];
+
+    for (size_t i = 0; i < ctx->channel_buffer_index; i++) {
+        ctx->channel_buffer[i].timeline = (struct timeline_t) {
+                .dense = true,
+                .wide = true,
+                .wide_frames = &slot[i * count],
+                .length = count,
+                .start = segment * window->segment_frame_count,
+        };
+    }
+}
+
+static void *window_worker_run(void *arg) {
+    struct window_t *window = arg;
+
+    pthread_mutex_lock(&window->lock);
+
+    while (!window->stop_requested) {
+        const frame_index_t segment = window->filled_segment_count;
+
+        // a segment is only filled once its slot is no longer held by the playing segment
+        if (segment >= window->segment_count || (segment > window->playing_segment && segment - window->playing_segment >= WINDOW_SEGMENT_COUNT)) {
+            pthread_cond_wait(&window->cond, &window->lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&window->lock);
+
+        const int err = window_fill(window->ctx, window, segment);
+
+        pthread_mutex_lock(&window->lock);
+
+        if (err) {
+            window->worker_err = err;
+            pthread_cond_broadcast(&window->cond);
+            break;
+        }
+
+        window->filled_segment_count = segment + 1;
+
+        pthread_cond_broadcast(&window->cond);
+    }
+
+    pthread_mutex_unlock(&window->lock);
+
+    // the worker's spans are handed over as it exits, and its buffer is reused by the next worker
+    trace_release();
+
+    return NULL;
+}
+
+int window_restore(struct libreorama_ctx *ctx,
+                   frame_index_t frame_index,
+                   const struct frame_t **frames) {
+    struct window_t *window = ctx->window;
+
+    if (frame_index > window->sequence.frame_count) {
+        frame_index = window->sequence.frame_count;
+    }
+
+    int err;
+    if ((err = window->source.restore(ctx, window->source.data, window->sequence, frame_index, ctx->restore_state_buffer))) {
+        return err;
+    }
+
+    for (size_t i = 0; i < ctx->channel_buffer_index; i++) {
+        ctx->restore_frame_buffer[i] = keyframe_sync_frame(ctx->restore_state_buffer[i], frame_index, window->sequence.step_time_ms);
+    }
+
+    *frames = ctx->restore_frame_buffer;
+
+    return 0;
+}
+
+int window_start(struct libreorama_ctx *ctx,
+                 frame_index_t frame_index) {
+    struct window_t *window = ctx->window;
+
+    window_stop(ctx);
+
+    const frame_index_t segment = frame_index / window->segment_frame_count;
+
+    window->playing_segment      = segment;
+    window->filled_segment_count = segment;
+    window->stop_requested       = false;
+    window->worker_err           = 0;
+    window->underrun_count       = 0;
+
+    // the first segment is filled before playback starts, only the following segments are filled by the worker
+    int err;
+
+    if (segment < window->segment_count) {
+        if ((err = window_fill(ctx, window, segment))) {
+            return err;
+        }
+
+        window->filled_segment_count = segment + 1;
+    }
+
+    window_point_timelines(ctx, window, segment);
+
+    // the worker never inherits real-time scheduling from the player (see realtime.h)
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+
+    const struct sched_param param = (struct sched_param) {
+            .sched_priority = 0,
+    };
+
+    pthread_attr_setschedparam(&attr, &param);
+
+    err = pthread_create(&window->worker, &attr, window_worker_run, window);
+
+    pthread_attr_destroy(&attr);
+
+    if (err) {
+        errno = err;
+        return LBR_EERRNO;
+    }
+
+    window->has_worker = true;
+
+    return 0;
+}
+
+int window_advance(struct libreorama_ctx *ctx,
+                   frame_index_t frame_index) {
+    struct window_t *window = ctx->window;
+
+    const frame_index_t segment = frame_index / window->segment_frame_count;
+
+    // playing_segment is only written by the player, it may be read without the lock
+    if (segment == window->playing_segment) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&window->lock);
+
+    window->playing_segment = segment;
+
+    // wake the worker, the slot of the previous segment is now free to be filled
+    pthread_cond_broadcast(&window->cond);
+
+    if (segment < window->segment_count && window->filled_segment_count <= segment) {
+        window->underrun_count++;
+
+        while (window->filled_segment_count <= segment && window->worker_err == 0) {
+            pthread_cond_wait(&window->cond, &window->lock);
+        }
+    }
+
+    const int err = window->worker_err;
+
+    pthread_mutex_unlock(&window->lock);
+
+    if (err) {
+        return err;
+    }
+
+    window_point_timelines(ctx, window, segment);
+
+    return 0;
+}
+
+void window_stop(struct libreorama_ctx *ctx) {
+    struct window_t *window = ctx->window;
+
+    if (window == NULL || !window->has_worker) {
+        return;
+    }
+
+    pthread_mutex_lock(&window->lock);
+
+    window->stop_requested = true;
+
+    pthread_cond_broadcast(&window->cond);
+    pthread_mutex_unlock(&window->lock);
+
+    pthread_join(window->worker, NULL);
+
+    window->has_worker = false;
+}
+
+void window_free(struct libreorama_ctx *ctx) {
+    struct window_t *window = ctx->window;
+
+    if (window == NULL) {
+        return;
+    }
+
+    window_stop(ctx);
+
+    window->source.free(window->source.data);
+
+    pthread_mutex_destroy(&window->lock);
+    pthread_cond_destroy(&window->cond);
+
+    // the slots are released with the frame arena, see #frame_buffer_free
+    free(window);
+
+    // release any dangling pointers and avoid double free
+    ctx->window = NULL;
+}
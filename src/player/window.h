@@ -0,0 +1,121 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LIBREORAMA_WINDOW_H
+#define LIBREORAMA_WINDOW_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "sequence.h"
+#include "../lorinterface/keyframe.h"
+
+// a window plays a sequence without materializing all of its frames up front
+// the sequence is split into segments, of which WINDOW_SEGMENT_COUNT are held in fixed storage at once
+// the segment being played is read by each channel's timeline, while a worker thread fills the next segment
+// memory is sized by the window length, regardless of the sequence length
+#define WINDOW_SEGMENT_COUNT 2
+
+struct libreorama_ctx;
+
+// produces the frames of a sequence on demand, such as by decoding a document kept resident (see lormedia.h)
+// fill is called by a single thread at a time, either the player while starting a window or its worker
+// restore is called by the player, and may run alongside a fill, so it must not modify state shared with fill
+struct window_source_t {
+    void *data;
+
+    // writes the frames of [start, start + count) into frames, as count zeroed frames for each channel in order
+    // only the frames of effects starting within the segment are set, frames are interned into the ctx palette
+    int (*fill)(struct libreorama_ctx *ctx,
+                void *data,
+                struct sequence_t sequence,
+                frame_index_t start,
+                frame_index_t count,
+                frame_palette_index_t *frames);
+
+    // writes each channel's most recently started frame prior to frame_index into states, as if the sequence was played
+    int (*restore)(struct libreorama_ctx *ctx,
+                   void *data,
+                   struct sequence_t sequence,
+                   frame_index_t frame_index,
+                   struct keyframe_state_t *states);
+
+    void (*free)(void *data);
+};
+
+struct window_t {
+    struct window_source_t source;
+    struct sequence_t      sequence;
+    frame_index_t          segment_frame_count;
+    frame_index_t          segment_count;
+
+    // segment n is held in slots[n % WINDOW_SEGMENT_COUNT], each slot is checked out of the frame arena
+    frame_palette_index_t *slots[WINDOW_SEGMENT_COUNT];
+
+    // fades synthesized within each filled segment, see #fadesynth_frames
+    unsigned long synthesized_fade_count;
+
+    // the number of segment boundaries where playback waited for the worker
+    unsigned long underrun_count;
+
+    // segments are filled in order, up to a single segment ahead of the playing segment
+    // state shared with the worker is guarded by lock, cond is signaled by each change
+    pthread_t       worker;
+    bool            has_worker;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    frame_index_t   playing_segment;
+    frame_index_t   filled_segment_count;
+    bool            stop_requested;
+    int             worker_err;
+
+    // the ctx whose palette the worker interns into, only held while the worker is running
+    struct libreorama_ctx *ctx;
+};
+
+// opens a window over the (sorted) channels of ctx, sized by ctx->window_ms
+// the window takes ownership of source, which is freed by #window_free (or here on error)
+int window_open(struct libreorama_ctx *ctx,
+                struct sequence_t sequence,
+                struct window_source_t source);
+
+// restores each channel's state as of frame_index, in place of #keyframe_restore
+int window_restore(struct libreorama_ctx *ctx,
+                   frame_index_t frame_index,
+                   const struct frame_t **frames);
+
+// fills the segment of frame_index and starts the worker, which fills each following segment
+int window_start(struct libreorama_ctx *ctx,
+                 frame_index_t frame_index);
+
+// points each channel's timeline at the segment of frame_index, waiting for the worker to fill it if needed
+// frames must be advanced in order, only the first frame of each segment does any work
+int window_advance(struct libreorama_ctx *ctx,
+                   frame_index_t frame_index);
+
+// stops the worker, if any
+void window_stop(struct libreorama_ctx *ctx);
+
+void window_free(struct libreorama_ctx *ctx);
+
+#endif //LIBREORAMA_WINDOW_H
@@ -0,0 +1,129 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// required for cpu_set_t & pthread_setaffinity_np
+#define _GNU_SOURCE
+#endif
+
+#include "realtime.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "ctx.h"
+#include "err/lbr.h"
+#include "player/compositor.h"
+
+static void realtime_prefault_stack(void) {
+    volatile unsigned char stack[REALTIME_STACK_PREFAULT_LENGTH];
+
+    for (size_t i = 0; i < sizeof(stack); i++) {
+        stack[i] = 0;
+    }
+}
+
+int realtime_enter(const struct realtime_config_t *config) {
+    if (config->cpu != REALTIME_CPU_NONE) {
+#ifdef __linux__
+        cpu_set_t cpu_set;
+
+        CPU_ZERO(&cpu_set);
+        CPU_SET(config->cpu, &cpu_set);
+
+        // pthread functions return the error number rather than setting errno
+        if ((errno = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set))) {
+            return LBR_EERRNO;
+        }
+#else
+        return LBR_REALTIME_EUNSUPPORTED;
+#endif
+    }
+
+    if (config->priority > 0) {
+        const struct sched_param param = (struct sched_param) {
+                .sched_priority = config->priority,
+        };
+
+        if ((errno = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param))) {
+            return LBR_EERRNO;
+        }
+
+        // lock all current and future allocations (including sequences loaded later) so they are never paged out
+        if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+            return LBR_EERRNO;
+        }
+
+        realtime_prefault_stack();
+    }
+
+    return 0;
+}
+
+void realtime_prefault(void *buf,
+                       size_t len) {
+    if (buf == NULL || len == 0) {
+        return;
+    }
+
+    const long page_size = sysconf(_SC_PAGESIZE);
+
+    volatile unsigned char *bytes = buf;
+
+    // write each page (not only read) to replace any shared zero page with a private one
+    for (size_t i = 0; i < len; i += (size_t) page_size) {
+        bytes[i] = bytes[i];
+    }
+
+    bytes[len - 1] = bytes[len - 1];
+}
+
+static void realtime_prefault_ctx_buffers(struct libreorama_ctx *ctx) {
+    for (struct frame_block_t *block = ctx->frame_blocks; block != NULL; block = block->next) {
+        realtime_prefault(block->words, sizeof(frame_word_t) * block->count);
+    }
+
+    // the palette slots are only used while interning frames during load
+    // the palette's full capacity is touched since a window's worker interns frames during playback (see window.h)
+    realtime_prefault(ctx->frame_palette, sizeof(struct frame_t) * ctx->frame_palette_capacity);
+
+    realtime_prefault(ctx->channel_block, ctx->channel_block_length);
+    realtime_prefault(ctx->keyframe_index, sizeof(struct keyframe_state_t) * ctx->keyframe_count * ctx->channel_buffer_index);
+}
+
+void realtime_prefault_ctx(struct libreorama_ctx *ctx) {
+    realtime_prefault_ctx_buffers(ctx);
+
+    if (ctx->compositor == NULL) {
+        return;
+    }
+
+    realtime_prefault_ctx_buffers(ctx->compositor->output);
+
+    for (size_t i = 0; i < ctx->compositor->layer_count; i++) {
+        realtime_prefault_ctx_buffers(ctx->compositor->layers[i].ctx);
+    }
+}
@@ -0,0 +1,57 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LIBREORAMA_REALTIME_H
+#define LIBREORAMA_REALTIME_H
+
+#include <stddef.h>
+
+// real-time mode is opt-in, see main.c
+// playback and serial writes share the thread which enters real-time mode
+#define REALTIME_CPU_NONE (-1)
+
+// the stack is prefaulted to this depth when entering real-time mode
+#define REALTIME_STACK_PREFAULT_LENGTH (64 * 1024)
+
+struct libreorama_ctx;
+
+struct realtime_config_t {
+    // SCHED_FIFO priority, or 0 to leave the scheduling policy unchanged
+    int priority;
+
+    // the cpu the thread is pinned to, or REALTIME_CPU_NONE
+    int cpu;
+};
+
+// moves the calling thread onto SCHED_FIFO, pins it to a cpu and locks all current & future memory
+// threads created afterwards inherit the scheduling policy, so this should be called after OpenAL is initialized
+int realtime_enter(const struct realtime_config_t *config);
+
+// touches each page of the buffer so playback does not take page faults on first access
+void realtime_prefault(void *buf,
+                       size_t len);
+
+// prefaults the frame & encode buffers of ctx, and of each compositor layer if present
+void realtime_prefault_ctx(struct libreorama_ctx *ctx);
+
+#endif //LIBREORAMA_REALTIME_H
@@ -25,13 +25,13 @@
 
 #include "lorparse.h"
 #include "../err/lbr.h"
+#include "../lorinterface/brightness.h"
 
-#define LOREFFECT_MAX_INTENSITY 100
+#define LOREFFECT_MAX_INTENSITY BRIGHTNESS_MAX_INTENSITY
 
-// LMS files use 0-100 for brightness scales
-// normalize the value and scale it against 255 (full byte)
+// LMS files use 0-100 for brightness scales, see BRIGHTNESS_INTENSITY_TABLE
 // this value will be encoded to a lor_brightness_t by encode.h
-#define LOREFFECT_BRIGHTNESS(x) ((unsigned char) (((float) (x) / 100.0f) * 255))
+#define LOREFFECT_BRIGHTNESS(x) (BRIGHTNESS_INTENSITY_TABLE[(unsigned char) (x)])
 
 int loreffect_get_frame(const xmlNode *effect_node,
                         struct frame_t *frame,
@@ -74,7 +74,7 @@ int loreffect_get_frame(const xmlNode *effect_node,
             frame->fade   = (struct frame_effect_fade_t) {
                     .from = LOREFFECT_BRIGHTNESS(start_intensity),
                     .to = LOREFFECT_BRIGHTNESS(end_intensity),
-                    .duration = lor_duration_of((float) (end_cs - start_cs) / 100.0f),
+                    .duration_cs = (unsigned short) (end_cs - start_cs),
             };
 
             return_code = 0;
@@ -23,26 +23,63 @@
  */
 #include "lormedia.h"
 
+#include <stdlib.h>
+
 #include "loreffect.h"
 #include "lorparse.h"
+#include "../ctx.h"
 #include "../err/lbr.h"
+#include "../trace.h"
 
-int lormedia_sequence_load(const char *sequence_file,
-                           char **audio_file_hint,
-                           struct sequence_t *sequence) {
-    int return_code = 0;
+static bool lormedia_channel_has_effects(const xmlNode *channel_node) {
+    for (const xmlNode *effect_node = channel_node->children; effect_node != NULL; effect_node = effect_node->next) {
+        if (xml_is_named_node(effect_node, "effect")) {
+            return true;
+        }
+    }
 
-    xmlInitParser();
+    return false;
+}
 
-    // implementation is derived from xmlsoft.org example
-    // see http://www.xmlsoft.org/examples/tree1.c
-    xmlDocPtr doc = xmlReadFile(sequence_file, NULL, 0);
+// the counts & elements found by #lormedia_sequence_scan, which channels are later requested from
+struct lormedia_scan_t {
+    const xmlNode *channels_element;
+    size_t        channel_count;
+    size_t        active_channel_count;
+    size_t        effect_node_count;
+};
+
+static unsigned long long lormedia_effect_frame_index(const xmlNode *effect_node,
+                                                      unsigned short step_time_ms) {
+    // from start_cs_prop (start time in centiseconds), scale against step_time_ms
+    //  to determine the frame_index for this effect_node
+    // this is because effect_nodes may be out of order, or in variable interval
+    const unsigned long start_cs = (unsigned long) xml_get_propertyl(effect_node, "startCentisecond");
+
+    return ((unsigned long long) start_cs * 10) / step_time_ms;
+}
 
-    if (doc == NULL) {
-        return_code = LBR_EERRNO;
-        goto lormedia_free;
+static int lormedia_effect_decode(struct libreorama_ctx *ctx,
+                                  const xmlNode *effect_node,
+                                  frame_palette_index_t *frame) {
+    const unsigned long start_cs = (unsigned long) xml_get_propertyl(effect_node, "startCentisecond");
+    const unsigned long end_cs   = (unsigned long) xml_get_propertyl(effect_node, "endCentisecond");
+
+    // effects are decoded over the existing frame, then interned into the palette
+    struct frame_t decoded = ctx->frame_palette[*frame];
+
+    int err;
+    if ((err = loreffect_get_frame(effect_node, &decoded, start_cs, end_cs))) {
+        return err;
     }
 
+    return frame_palette_intern(ctx, decoded, frame);
+}
+
+static int lormedia_sequence_scan(xmlDocPtr doc,
+                                  char **audio_file_hint,
+                                  struct sequence_t *sequence,
+                                  struct lormedia_scan_t *scan) {
     // the document will have a single element, named sequence
     // this assumes it is the 2nd element in the document at root level
     const xmlNode *root_element     = xmlDocGetRootElement(doc);
@@ -60,11 +97,26 @@ int lormedia_sequence_load(const char *sequence_file,
     // use the startCentisecond & endCentisecond properties to understand each effects time length
     // select the lowest value to be used for the step_time
     // this ensures the program automatically runs at the precision needed
-    const xmlNode *channels_element = xml_find_node_child(sequence_element, "channels");
-    xmlNode       *channel_node     = channels_element->children;
+    scan->channels_element = xml_find_node_child(sequence_element, "channels");
+
+    xmlNode *channel_node = scan->channels_element->children;
+
+    // channels & effects are also counted so that their timelines may be reserved up front
+    // channels without effects keep an empty timeline
+    scan->channel_count        = 0;
+    scan->active_channel_count = 0;
+    scan->effect_node_count    = 0;
+
+    uint64_t trace_start_ns = trace_begin();
 
     while (channel_node != NULL) {
         if (xml_is_named_node(channel_node, "channel")) {
+            scan->channel_count++;
+
+            if (lormedia_channel_has_effects(channel_node)) {
+                scan->active_channel_count++;
+            }
+
             // iterate over each child node in channels_child
             // these are the actual effects entries containing time data
             xmlNode *effect_node = channel_node->children;
@@ -74,6 +126,8 @@ int lormedia_sequence_load(const char *sequence_file,
                     const unsigned long start_cs = (unsigned long) xml_get_propertyl(effect_node, "startCentisecond");
                     const unsigned long end_cs   = (unsigned long) xml_get_propertyl(effect_node, "endCentisecond");
 
+                    scan->effect_node_count++;
+
                     // test if the difference, in milliseconds, is below the smallest step time threshold
                     const unsigned short current_step_time_ms = (unsigned short) ((end_cs - start_cs) * 10);
 
@@ -89,6 +143,8 @@ int lormedia_sequence_load(const char *sequence_file,
         channel_node = channel_node->next;
     }
 
+    trace_end("step_time_scan", trace_start_ns);
+
     // read the <tracks> element
     // each child will contain a "totalCentiseconds" property
     // locate the highest value to be used as a "total sequence duration" value
@@ -111,22 +167,97 @@ int lormedia_sequence_load(const char *sequence_file,
 
     // convert the highest_total_cs value from centiseconds into a frame_count
     // this used the previously determined step_time as a frame interval time
-    sequence->frame_count = (frame_index_t) ((highest_total_cs * 10) / sequence->step_time_ms);
+    const unsigned long long frame_count = ((unsigned long long) highest_total_cs * 10) / sequence->step_time_ms;
 
-    // reset channel_node value since it was previously iterated
-    channel_node = channels_element->children;
+    // reject sequences which cannot be indexed, or whose scratch frames cannot be addressed, rather than truncating them
+    if (frame_count > FRAME_INDEX_MAX || frame_count > SIZE_MAX / sizeof(frame_palette_index_t)) {
+        return LBR_SEQUENCE_ETOOLONG;
+    }
+
+    sequence->frame_count = (frame_index_t) frame_count;
+
+    return 0;
+}
+
+static int lormedia_channel_request(struct libreorama_ctx *ctx,
+                                    const xmlNode *channel_node,
+                                    struct channel_t **channel) {
+    // append the channel_node to the sequence channels
+    // offset channel by 1 since circuit is index 1 based
+    const lor_unit_t    unit    = (lor_unit_t) xml_get_propertyl(channel_node, "unit");
+    const lor_channel_t circuit = (lor_channel_t) (xml_get_propertyl(channel_node, "circuit") - 1);
+
+    return channel_buffer_request(ctx, unit, circuit, channel);
+}
+
+int lormedia_sequence_load(struct libreorama_ctx *ctx,
+                           const char *sequence_file,
+                           char **audio_file_hint,
+                           struct sequence_t *sequence) {
+    int return_code = 0;
+
+    // implementation is derived from xmlsoft.org example
+    // see http://www.xmlsoft.org/examples/tree1.c
+    uint64_t trace_start_ns = trace_begin();
+
+    xmlDocPtr doc = xmlReadFile(sequence_file, NULL, 0);
+
+    trace_end("xml_parse", trace_start_ns);
+
+    if (doc == NULL) {
+        return_code = LBR_EERRNO;
+        goto lormedia_free;
+    }
+
+    struct lormedia_scan_t scan;
+
+    int err;
+    if ((err = lormedia_sequence_scan(doc, audio_file_hint, sequence, &scan))) {
+        return_code = err;
+        goto lormedia_free;
+    }
+
+    // size the channel storage & reserve every channel's timeline in a single block
+    // each effect starts at most a single run, in addition to a leading run & any runs splitting long gaps (see timeline.h)
+    // each timeline's request may also be rounded by a word (see FRAME_BLOCK_REQUEST_ALIGNMENT)
+    // this keeps the channel scan below allocation free, besides the scratch frames each timeline is encoded from
+    // (and any wide timelines, which are not expected)
+    const size_t run_count = scan.effect_node_count + scan.active_channel_count * (1 + sequence->frame_count / TIMELINE_RUN_MAX_LENGTH);
+
+    if ((err = channel_buffer_reserve(ctx, scan.channel_count))) {
+        return_code = err;
+        goto lormedia_free;
+    }
+
+    if ((err = frame_buffer_reserve(ctx, run_count * (sizeof(struct timeline_run_t) / sizeof(frame_word_t)) + scan.active_channel_count))) {
+        return_code = err;
+        goto lormedia_free;
+    }
+
+    xmlNode *channel_node = scan.channels_element->children;
+
+    trace_start_ns = trace_begin();
 
     while (channel_node != NULL) {
         if (xml_is_named_node(channel_node, "channel")) {
-            // append the channel_node to the sequence channels
-            // offset channel by 1 since circuit is index 1 based
-            const lor_unit_t    unit    = (lor_unit_t) xml_get_propertyl(channel_node, "unit");
-            const lor_channel_t circuit = (lor_channel_t) (xml_get_propertyl(channel_node, "circuit") - 1);
-
             // append the channel_node to the sequence channels
             struct channel_t *channel = NULL;
 
-            if ((err = channel_buffer_request(unit, circuit, sequence->frame_count, &channel))) {
+            if ((err = lormedia_channel_request(ctx, channel_node, &channel))) {
+                return_code = err;
+                goto lormedia_free;
+            }
+
+            // channels without effects keep their empty timeline
+            if (!lormedia_channel_has_effects(channel_node)) {
+                channel_node = channel_node->next;
+                continue;
+            }
+
+            // effects may be out of order, so they are written to dense scratch frames before the timeline is encoded
+            frame_palette_index_t *frames;
+
+            if ((err = frame_buffer_scratch(ctx, sequence->frame_count, &frames))) {
                 return_code = err;
                 goto lormedia_free;
             }
@@ -137,35 +268,319 @@ int lormedia_sequence_load(const char *sequence_file,
 
             while (effect_node != NULL) {
                 if (xml_is_named_node(effect_node, "effect")) {
-                    const unsigned long start_cs = (unsigned long) xml_get_propertyl(effect_node, "startCentisecond");
-                    const unsigned long end_cs   = (unsigned long) xml_get_propertyl(effect_node, "endCentisecond");
+                    const unsigned long long frame_index_start = lormedia_effect_frame_index(effect_node, sequence->step_time_ms);
 
-                    // from start/end_cs_prop (start time in centiseconds), scale against step_time_ms
-                    //  to determine the frame_index for this effect_node
-                    // this is because effect_nodes may be out of order, or in variable interval
-                    const frame_index_t frame_index_start = (frame_index_t) ((start_cs * 10) / sequence->step_time_ms);
-                    struct frame_t      *frame            = &channel->frame_data[frame_index_start];
+                    // effects starting at or after the end of the longest track are never played
+                    if (frame_index_start >= sequence->frame_count) {
+                        effect_node = effect_node->next;
+                        continue;
+                    }
 
-                    if ((err = loreffect_get_frame(effect_node, frame, start_cs, end_cs))) {
+                    if ((err = lormedia_effect_decode(ctx, effect_node, &frames[frame_index_start]))) {
                         return_code = err;
                         goto lormedia_free;
                     }
+
+                    sequence->effect_count++;
                 }
 
                 effect_node = effect_node->next;
             }
+
+            if ((err = timeline_store(ctx, &channel->timeline, frames, sequence->frame_count))) {
+                return_code = err;
+                goto lormedia_free;
+            }
         }
 
         channel_node = channel_node->next;
     }
 
+    trace_end("channel_scan", trace_start_ns);
+
     lormedia_free:
     xmlFreeDoc(doc);
 
-    // cleanup parser state, this pairs with #xmlInitParser
-    // it may be a CPU waste to init/cleanup each load call
-    // but this ensures that during playback, there is no wasted memory
-    xmlCleanupParser();
+    // parser state is initialized once per process by the caller (see #xmlInitParser)
+    // it is not cleaned up here since other contexts may be loading concurrently
+    return return_code;
+}
+
+// each channel of an opened sequence, indexed by the sorted channel_buffer
+struct lormedia_source_channel_t {
+    const xmlNode *channel_node;
+
+    // the next effect to be filled, effects are only skipped by a cursor when they are in order
+    const xmlNode *effect_cursor;
+    bool          effects_ordered;
+};
+
+// an opened sequence, whose document is kept resident so that frames are decoded on demand
+struct lormedia_source_t {
+    xmlDocPtr                        doc;
+    const xmlNode                    *channels_element;
+    struct lormedia_source_channel_t *channels;
+    size_t                           channel_count;
+    bool                             bound;
+
+    // the end of the most recently filled segment, which each effect_cursor has advanced up to
+    frame_index_t cursor_frame_index;
+};
+
+static void lormedia_source_bind(struct libreorama_ctx *ctx,
+                                 struct lormedia_source_t *source,
+                                 struct sequence_t sequence) {
+    // channels are sorted after being requested, so each channel_node is bound to its sorted index once
+    for (const xmlNode *channel_node = source->channels_element->children; channel_node != NULL; channel_node = channel_node->next) {
+        if (!xml_is_named_node(channel_node, "channel")) {
+            continue;
+        }
+
+        const lor_unit_t    unit    = (lor_unit_t) xml_get_propertyl(channel_node, "unit");
+        const lor_channel_t circuit = (lor_channel_t) (xml_get_propertyl(channel_node, "circuit") - 1);
+
+        // channels sharing a unit & circuit are adjacent once sorted, each is bound to the first unbound of them
+        size_t i = channel_buffer_find(ctx, unit, circuit);
+
+        while (source->channels[i].channel_node != NULL) {
+            i++;
+        }
+
+        struct lormedia_source_channel_t *channel = &source->channels[i];
+
+        channel->channel_node    = channel_node;
+        channel->effect_cursor   = channel_node->children;
+        channel->effects_ordered = true;
+
+        // most channels list their effects in order, which allows each fill to resume from the previous fill
+        unsigned long long previous_frame_index = 0;
+
+        for (const xmlNode *effect_node = channel_node->children; effect_node != NULL; effect_node = effect_node->next) {
+            if (xml_is_named_node(effect_node, "effect")) {
+                const unsigned long long frame_index = lormedia_effect_frame_index(effect_node, sequence.step_time_ms);
+
+                if (frame_index < previous_frame_index) {
+                    channel->effects_ordered = false;
+                    break;
+                }
+
+                previous_frame_index = frame_index;
+            }
+        }
+    }
+
+    source->bound = true;
+}
+
+static int lormedia_source_fill(struct libreorama_ctx *ctx,
+                                void *data,
+                                struct sequence_t sequence,
+                                frame_index_t start,
+                                frame_index_t count,
+                                frame_palette_index_t *frames) {
+    struct lormedia_source_t *source = data;
+
+    if (!source->bound) {
+        lormedia_source_bind(ctx, source, sequence);
+    }
+
+    // filling an earlier segment (such as when the sequence is replayed) restarts each cursor from its first effect
+    if (start < source->cursor_frame_index) {
+        for (size_t i = 0; i < source->channel_count; i++) {
+            source->channels[i].effect_cursor = source->channels[i].channel_node->children;
+        }
+    }
+
+    const unsigned long long end = (unsigned long long) start + count;
+
+    for (size_t i = 0; i < source->channel_count; i++) {
+        struct lormedia_source_channel_t *channel = &source->channels[i];
+
+        const xmlNode *effect_node = channel->effects_ordered ? channel->effect_cursor : channel->channel_node->children;
+
+        for (; effect_node != NULL; effect_node = effect_node->next) {
+            if (!xml_is_named_node(effect_node, "effect")) {
+                continue;
+            }
+
+            const unsigned long long frame_index_start = lormedia_effect_frame_index(effect_node, sequence.step_time_ms);
+
+            if (frame_index_start < start) {
+                continue;
+            }
+
+            // ordered effects past the segment are left for the next fill
+            if (frame_index_start >= end) {
+                if (channel->effects_ordered) {
+                    break;
+                }
+
+                continue;
+            }
+
+            int err;
+            if ((err = lormedia_effect_decode(ctx, effect_node, &frames[i * count + (frame_index_start - start)]))) {
+                return err;
+            }
+        }
+
+        channel->effect_cursor = effect_node;
+    }
+
+    source->cursor_frame_index = (frame_index_t) end;
+
+    return 0;
+}
+
+static int lormedia_source_restore(struct libreorama_ctx *ctx,
+                                   void *data,
+                                   struct sequence_t sequence,
+                                   frame_index_t frame_index,
+                                   struct keyframe_state_t *states) {
+    struct lormedia_source_t *source = data;
+
+    if (!source->bound) {
+        lormedia_source_bind(ctx, source, sequence);
+    }
+
+    for (size_t i = 0; i < source->channel_count; i++) {
+        const struct lormedia_source_channel_t *channel = &source->channels[i];
+
+        struct keyframe_state_t state = (struct keyframe_state_t) {
+                .frame = ZERO_FRAME,
+        };
+
+        // the most recently started effect is the channel's state, effects starting together are decoded over each other
+        for (const xmlNode *effect_node = channel->channel_node->children; effect_node != NULL; effect_node = effect_node->next) {
+            if (!xml_is_named_node(effect_node, "effect")) {
+                continue;
+            }
+
+            const unsigned long long frame_index_start = lormedia_effect_frame_index(effect_node, sequence.step_time_ms);
+
+            if (frame_index_start >= frame_index) {
+                if (channel->effects_ordered) {
+                    break;
+                }
+
+                continue;
+            }
+
+            if (frame_is_set(state.frame) && frame_index_start < state.frame_index) {
+                continue;
+            }
+
+            if (!frame_is_set(state.frame) || frame_index_start > state.frame_index) {
+                state.frame       = ZERO_FRAME;
+                state.frame_index = (frame_index_t) frame_index_start;
+            }
+
+            const unsigned long start_cs = (unsigned long) xml_get_propertyl(effect_node, "startCentisecond");
+            const unsigned long end_cs   = (unsigned long) xml_get_propertyl(effect_node, "endCentisecond");
+
+            int err;
+            if ((err = loreffect_get_frame(effect_node, &state.frame, start_cs, end_cs))) {
+                return err;
+            }
+        }
+
+        states[i] = state;
+    }
+
+    return 0;
+}
+
+static void lormedia_source_free(void *data) {
+    struct lormedia_source_t *source = data;
+
+    xmlFreeDoc(source->doc);
+
+    free(source->channels);
+    free(source);
+}
+
+int lormedia_sequence_open(struct libreorama_ctx *ctx,
+                           const char *sequence_file,
+                           char **audio_file_hint,
+                           struct sequence_t *sequence,
+                           struct window_source_t *source) {
+    int return_code = 0;
+
+    struct lormedia_source_t *lormedia_source = NULL;
+
+    uint64_t trace_start_ns = trace_begin();
+
+    xmlDocPtr doc = xmlReadFile(sequence_file, NULL, 0);
+
+    trace_end("xml_parse", trace_start_ns);
+
+    if (doc == NULL) {
+        return_code = LBR_EERRNO;
+        goto lormedia_open_free;
+    }
+
+    struct lormedia_scan_t scan;
+
+    int err;
+    if ((err = lormedia_sequence_scan(doc, audio_file_hint, sequence, &scan))) {
+        return_code = err;
+        goto lormedia_open_free;
+    }
+
+    if ((err = channel_buffer_reserve(ctx, scan.channel_count))) {
+        return_code = err;
+        goto lormedia_open_free;
+    }
+
+    // channels are requested with empty timelines, which the window points at each of its segments
+    trace_start_ns = trace_begin();
+
+    for (const xmlNode *channel_node = scan.channels_element->children; channel_node != NULL; channel_node = channel_node->next) {
+        if (xml_is_named_node(channel_node, "channel")) {
+            struct channel_t *channel = NULL;
+
+            if ((err = lormedia_channel_request(ctx, channel_node, &channel))) {
+                return_code = err;
+                goto lormedia_open_free;
+            }
+        }
+    }
+
+    trace_end("channel_scan", trace_start_ns);
+
+    // effects are only decoded once filled, every effect is counted as played
+    sequence->effect_count = scan.effect_node_count;
+
+    if ((lormedia_source = calloc(1, sizeof(struct lormedia_source_t))) == NULL) {
+        return_code = LBR_EERRNO;
+        goto lormedia_open_free;
+    }
+
+    if ((lormedia_source->channels = calloc(scan.channel_count, sizeof(struct lormedia_source_channel_t))) == NULL) {
+        return_code = LBR_EERRNO;
+        goto lormedia_open_free;
+    }
+
+    lormedia_source->doc              = doc;
+    lormedia_source->channels_element = scan.channels_element;
+    lormedia_source->channel_count    = scan.channel_count;
+
+    *source = (struct window_source_t) {
+            .data = lormedia_source,
+            .fill = lormedia_source_fill,
+            .restore = lormedia_source_restore,
+            .free = lormedia_source_free,
+    };
+
+    return 0;
+
+    lormedia_open_free:
+    xmlFreeDoc(doc);
+
+    if (lormedia_source != NULL) {
+        free(lormedia_source->channels);
+        free(lormedia_source);
+    }
 
     return return_code;
 }
@@ -25,9 +25,19 @@
 #define LIBREORAMA_LORMEDIA_H
 
 #include "../player/sequence.h"
+#include "../player/window.h"
 
-int lormedia_sequence_load(const char *sequence_file,
+int lormedia_sequence_load(struct libreorama_ctx *ctx,
+                           const char *sequence_file,
                            char **audio_file_hint,
                            struct sequence_t *sequence);
 
+// parses the sequence like #lormedia_sequence_load, but only requests its channels (with empty timelines)
+// the document is kept resident by source, which decodes the frames of each window segment on demand
+int lormedia_sequence_open(struct libreorama_ctx *ctx,
+                           const char *sequence_file,
+                           char **audio_file_hint,
+                           struct sequence_t *sequence,
+                           struct window_source_t *source);
+
 #endif //LIBREORAMA_LORMEDIA_H
@@ -0,0 +1,316 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <getopt.h>
+#include <string.h>
+
+#include <libxml/parser.h>
+
+#include "ctx.h"
+#include "err/lbr.h"
+#include "lorinterface/brightness.h"
+#include "lorinterface/duration.h"
+#include "lorinterface/encode.h"
+#include "lorinterface/minify.h"
+#include "player/player.h"
+
+// libreorama_bandwidth replays a sequence through the minify/encode pipeline without any output
+//  and reports the bytes written per frame, per unit and per command type against the link capacity
+// this is used to plan baud rates and network splits before a show
+
+// 8N1 framing sends a start and stop bit alongside each data byte
+#define BANDWIDTH_BITS_PER_BYTE 10
+
+static void print_usage(void) {
+    printf("Usage: libreorama_bandwidth [options] <sequence file path>\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("\t-b <serial port baud rate> (defaults to 19200)\n");
+    printf("\t-t <minify tolerance in brightness curve steps> (defaults to 0)\n");
+    printf("\t-x (replaces identical commands sent to several units with a broadcast)\n");
+    printf("\t-B (addresses circuits beyond 16 with banked channel masks)\n");
+    printf("\t-o <CSV report file path> (writes a row per frame, with a column per unit)\n");
+}
+
+static int compare_size(const void *a,
+                        const void *b) {
+    const size_t x = *(const size_t *) a;
+    const size_t y = *(const size_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+static void print_csv_header(FILE *csv_file,
+                             const bool *units) {
+    fprintf(csv_file, "frame_index,time_ms,bytes,utilization,overrun");
+
+    for (int unit = 0; unit <= UCHAR_MAX; unit++) {
+        if (units[unit]) {
+            fprintf(csv_file, ",unit_%02x", unit);
+        }
+    }
+
+    fprintf(csv_file, "\n");
+}
+
+int main(int argc,
+         char **argv) {
+    int           baud_rate        = 19200;
+    unsigned char minify_tolerance = 0;
+    bool          broadcast_dedup  = false;
+    bool          channel_banks    = false;
+    char          *csv_file_path   = NULL;
+
+    int c;
+    while ((c = getopt(argc, argv, ":hb:t:xBo:")) != -1) {
+        switch (c) {
+            case 'h':
+                print_usage();
+                return 0;
+            case 'b': {
+                long baud_ratel = strtol(optarg, NULL, 10);
+
+                if (baud_ratel <= 0 || baud_ratel > INT_MAX) {
+                    fprintf(stderr, "invalid baud rate: %ld\n", baud_ratel);
+                    return 1;
+                }
+
+                baud_rate = (int) baud_ratel;
+                break;
+            }
+            case 't': {
+                long tolerancel = strtol(optarg, NULL, 10);
+
+                if (tolerancel < 0 || tolerancel > UCHAR_MAX) {
+                    fprintf(stderr, "invalid minify tolerance: %ld\n", tolerancel);
+                    return 1;
+                }
+
+                minify_tolerance = (unsigned char) tolerancel;
+                break;
+            }
+            case 'x':
+                broadcast_dedup = true;
+                break;
+            case 'B':
+                channel_banks = true;
+                break;
+            case 'o':
+                csv_file_path = optarg;
+                break;
+            case ':':
+                fprintf(stderr, "option is missing argument: %c\n", optopt);
+                return 1;
+            case '?':
+            default:
+                fprintf(stderr, "unknown option: %c\n", optopt);
+                return 1;
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc < 1) {
+        print_usage();
+        return 1;
+    }
+
+    struct libreorama_ctx *ctx          = malloc(sizeof(struct libreorama_ctx));
+    struct encode_stats_t *stats        = NULL;
+    size_t                *frame_bytes  = NULL;
+    size_t                *sorted_bytes = NULL;
+    FILE                  *csv_file     = NULL;
+    int                   ret           = 1;
+
+    if (ctx == NULL) {
+        lbr_perror(LBR_EERRNO, "failed to allocate context");
+        goto bandwidth_free;
+    }
+
+    // the context is initialized before any other allocation, so that it is always safe to free
+    libreorama_ctx_init(ctx);
+
+    if ((stats = calloc(1, sizeof(struct encode_stats_t))) == NULL) {
+        lbr_perror(LBR_EERRNO, "failed to allocate encode stats");
+        goto bandwidth_free;
+    }
+
+    brightness_tables_init();
+#ifdef LIBREORAMA_FIXED_POINT
+    duration_table_init();
+#endif
+    xmlInitParser();
+
+    struct sequence_t sequence;
+
+    int err;
+    if ((err = player_load_layer(ctx, argv[0], &sequence))) {
+        lbr_perror(err, "failed to load sequence");
+        goto bandwidth_free;
+    }
+
+    frame_bytes  = malloc(sizeof(size_t) * sequence.frame_count);
+    sorted_bytes = malloc(sizeof(size_t) * sequence.frame_count);
+
+    if (frame_bytes == NULL || sorted_bytes == NULL) {
+        lbr_perror(LBR_EERRNO, "failed to allocate frame report");
+        goto bandwidth_free;
+    }
+
+    // units are listed in the order of the (sorted) channel buffer, with broadcast messages last
+    bool units[UCHAR_MAX + 1] = {false};
+
+    for (size_t i = 0; i < ctx->channel_buffer_index; i++) {
+        units[ctx->channel_buffer[i].unit] = true;
+    }
+    units[LOR_UNIT_ID_BROADCAST] = true;
+
+    if (csv_file_path != NULL) {
+        if ((csv_file = fopen(csv_file_path, "w")) == NULL) {
+            lbr_perror(LBR_EERRNO, "failed to open CSV report file");
+            goto bandwidth_free;
+        }
+
+        print_csv_header(csv_file, units);
+    }
+
+    // the number of bytes the UART can send within a single step_time_ms
+    const double frame_capacity = (double) baud_rate / BANDWIDTH_BITS_PER_BYTE * sequence.step_time_ms / 1000.0;
+
+    unsigned long last_unit_bytes[UCHAR_MAX + 1] = {0};
+    unsigned long total_bytes                    = 0;
+    unsigned long overrun_count                  = 0;
+
+    ctx->encode_stats     = stats;
+    ctx->minify_tolerance = minify_tolerance;
+    ctx->broadcast_dedup  = broadcast_dedup;
+    ctx->channel_banks    = channel_banks;
+
+    for (frame_index_t frame_index = 0; frame_index < sequence.frame_count; frame_index++) {
+        if ((err = minify_frame(ctx, sequence, frame_index))) {
+            lbr_perror(err, "failed to minify frame");
+            goto bandwidth_free;
+        }
+
+        if ((err = encode_heartbeat_frame(ctx, frame_index, sequence.step_time_ms))) {
+            lbr_perror(err, "failed to encode heartbeat");
+            goto bandwidth_free;
+        }
+
+        const size_t bytes = ctx->encode_buffer_index;
+
+        frame_bytes[frame_index] = bytes;
+        total_bytes += bytes;
+
+        if (bytes > frame_capacity) {
+            overrun_count++;
+        }
+
+        if (csv_file != NULL) {
+            fprintf(csv_file, "%u,%lu,%zu,%.3f,%d", frame_index, (unsigned long) frame_index * sequence.step_time_ms, bytes, bytes / frame_capacity, bytes > frame_capacity);
+
+            for (int unit = 0; unit <= UCHAR_MAX; unit++) {
+                if (units[unit]) {
+                    fprintf(csv_file, ",%lu", stats->unit_bytes[unit] - last_unit_bytes[unit]);
+                }
+            }
+
+            fprintf(csv_file, "\n");
+
+            memcpy(last_unit_bytes, stats->unit_bytes, sizeof(last_unit_bytes));
+        }
+
+        encode_buffer_reset(ctx);
+    }
+
+    memcpy(sorted_bytes, frame_bytes, sizeof(size_t) * sequence.frame_count);
+    qsort(sorted_bytes, sequence.frame_count, sizeof(size_t), compare_size);
+
+    // nearest-rank percentile, ceil(0.99 * frame_count)
+    const size_t p99_bytes  = sorted_bytes[(sequence.frame_count * 99 + 99) / 100 - 1];
+    const size_t peak_bytes = sorted_bytes[sequence.frame_count - 1];
+    const double avg_bytes  = (double) total_bytes / sequence.frame_count;
+
+    printf("sequence_file: %s\n", argv[0]);
+    printf("baud_rate: %d (%.1f bytes per %dms frame)\n", baud_rate, frame_capacity, sequence.step_time_ms);
+    printf("frame_count: %u\n", sequence.frame_count);
+    printf("total_bytes: %lu\n", total_bytes);
+    printf("\n");
+    printf("%-12s %10s %10s %10s\n", "", "avg", "p99", "peak");
+    printf("%-12s %10.1f %10zu %10zu\n", "bytes", avg_bytes, p99_bytes, peak_bytes);
+    printf("%-12s %9.1f%% %9.1f%% %9.1f%%\n", "utilization", avg_bytes / frame_capacity * 100, p99_bytes / frame_capacity * 100, peak_bytes / frame_capacity * 100);
+    printf("\n");
+    printf("%-12s %12s %12s %8s\n", "unit", "bytes", "bytes/frame", "share");
+
+    for (int unit = 0; unit <= UCHAR_MAX; unit++) {
+        if (units[unit]) {
+            printf("%-12.2x %12lu %12.2f %7.1f%%\n", unit, stats->unit_bytes[unit], (double) stats->unit_bytes[unit] / sequence.frame_count, total_bytes > 0 ? (double) stats->unit_bytes[unit] / total_bytes * 100 : 0);
+        }
+    }
+
+    printf("\n");
+    printf("%-16s %10s %12s %8s\n", "command", "count", "bytes", "share");
+
+    for (int command = 0; command < ENCODE_STATS_COMMAND_COUNT; command++) {
+        printf("%-16s %10lu %12lu %7.1f%%\n", ENCODE_STATS_COMMAND_NAMES[command], stats->command_count[command], stats->command_bytes[command], total_bytes > 0 ? (double) stats->command_bytes[command] / total_bytes * 100 : 0);
+    }
+
+    // frames which cannot be fully sent before the next frame is due
+    // these frames delay all following output until the link catches up
+    printf("\n");
+    printf("overrun frames: %lu\n", overrun_count);
+
+    if (overrun_count > 0) {
+        printf("%-12s %10s %10s %12s\n", "frame_index", "time_ms", "bytes", "utilization");
+
+        for (frame_index_t frame_index = 0; frame_index < sequence.frame_count; frame_index++) {
+            if (frame_bytes[frame_index] > frame_capacity) {
+                printf("%-12u %10lu %10zu %11.1f%%\n", frame_index, (unsigned long) frame_index * sequence.step_time_ms, frame_bytes[frame_index], frame_bytes[frame_index] / frame_capacity * 100);
+            }
+        }
+    }
+
+    ret = 0;
+
+    bandwidth_free:
+    if (csv_file != NULL) {
+        fclose(csv_file);
+    }
+
+    if (ctx != NULL) {
+        libreorama_ctx_free(ctx);
+    }
+
+    free(sorted_bytes);
+    free(frame_bytes);
+    free(stats);
+    free(ctx);
+
+    xmlCleanupParser();
+
+    return ret;
+}
@@ -0,0 +1,380 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "trace.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "err/lbr.h"
+
+struct trace_event_t {
+    const char *name;
+    uint64_t   start_ns;
+    uint64_t   duration_ns;
+    long       arg;
+};
+
+struct trace_buffer_t {
+    struct trace_event_t  events[TRACE_BUFFER_EVENT_COUNT];
+    size_t                event_count;
+    unsigned long         tid;
+
+    // links the buffer within the pending or free list, whichever currently holds it
+    struct trace_buffer_t *next;
+
+    // links every allocated buffer, so #trace_close can flush and free them
+    struct trace_buffer_t *next_allocated;
+};
+
+static bool            trace_enabled;
+static FILE            *trace_file;
+static uint64_t        trace_epoch_ns;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  trace_cond  = PTHREAD_COND_INITIALIZER;
+
+// buffers are written by a writer thread, so recording threads never wait on the trace file
+// full buffers are queued (in order) onto the pending list, and returned to the free list once written
+static pthread_t             trace_writer;
+static bool                  trace_writer_stop;
+static struct trace_buffer_t *trace_pending_head;
+static struct trace_buffer_t *trace_pending_tail;
+static struct trace_buffer_t *trace_free;
+static struct trace_buffer_t *trace_allocated;
+static unsigned long         trace_next_tid = 1;
+
+static __thread struct trace_buffer_t *trace_thread_buffer;
+static __thread unsigned long         trace_thread_tid;
+static __thread unsigned long         trace_thread_dropped_count;
+
+static uint64_t trace_now_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+// writes the buffer's spans to the trace file, only the writer thread (or #trace_close once it has stopped) may call this
+static void trace_buffer_write(struct trace_buffer_t *buffer) {
+    const long pid = (long) getpid();
+
+    for (size_t i = 0; i < buffer->event_count; i++) {
+        const struct trace_event_t *event = &buffer->events[i];
+
+        // ts & dur are microseconds, written with nanosecond precision
+        const uint64_t ts_ns = event->start_ns - trace_epoch_ns;
+
+        fprintf(trace_file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%lu,\"ts\":%llu.%03llu,\"dur\":%llu.%03llu",
+                event->name,
+                pid,
+                buffer->tid,
+                (unsigned long long) (ts_ns / 1000u),
+                (unsigned long long) (ts_ns % 1000u),
+                (unsigned long long) (event->duration_ns / 1000u),
+                (unsigned long long) (event->duration_ns % 1000u));
+
+        if (event->arg != TRACE_NO_ARG) {
+            fprintf(trace_file, ",\"args\":{\"value\":%ld}", event->arg);
+        }
+
+        fprintf(trace_file, "},\n");
+    }
+
+    buffer->event_count = 0;
+}
+
+static void *trace_writer_main(void *arg) {
+    pthread_mutex_lock(&trace_mutex);
+
+    while (true) {
+        while (trace_pending_head == NULL && !trace_writer_stop) {
+            pthread_cond_wait(&trace_cond, &trace_mutex);
+        }
+
+        // pending buffers are always drained before stopping
+        if (trace_pending_head == NULL) {
+            break;
+        }
+
+        struct trace_buffer_t *buffer = trace_pending_head;
+
+        if ((trace_pending_head = buffer->next) == NULL) {
+            trace_pending_tail = NULL;
+        }
+
+        // the file is only written by this thread, the lock is released while writing
+        pthread_mutex_unlock(&trace_mutex);
+
+        trace_buffer_write(buffer);
+        fflush(trace_file);
+
+        pthread_mutex_lock(&trace_mutex);
+
+        buffer->next = trace_free;
+        trace_free   = buffer;
+    }
+
+    pthread_mutex_unlock(&trace_mutex);
+
+    (void) arg;
+
+    return NULL;
+}
+
+int trace_open(const char *path) {
+    if ((trace_file = fopen(path, "w")) == NULL) {
+        return LBR_EERRNO;
+    }
+
+    // the array is left unterminated until #trace_close, which is valid for truncated traces
+    fprintf(trace_file, "[\n");
+
+    trace_writer_stop = false;
+
+    // the writer is created before real-time mode is entered, and keeps the default scheduling policy
+    int err;
+    if ((err = pthread_create(&trace_writer, NULL, trace_writer_main, NULL))) {
+        fclose(trace_file);
+
+        trace_file = NULL;
+        errno      = err;
+
+        return LBR_EERRNO;
+    }
+
+    trace_epoch_ns = trace_now_ns();
+    trace_enabled  = true;
+
+    return 0;
+}
+
+// returns a written buffer for reuse, or allocates one if alloc is set, trace_mutex must be held
+static struct trace_buffer_t *trace_buffer_take(bool alloc) {
+    struct trace_buffer_t *buffer = trace_free;
+
+    if (buffer != NULL) {
+        trace_free = buffer->next;
+    } else if (alloc && (buffer = malloc(sizeof(struct trace_buffer_t))) != NULL) {
+        buffer->event_count = 0;
+
+        buffer->next_allocated = trace_allocated;
+        trace_allocated        = buffer;
+    } else {
+        return NULL;
+    }
+
+    buffer->tid = trace_thread_tid;
+
+    return buffer;
+}
+
+// queues the buffer for the writer, trace_mutex must be held
+static void trace_buffer_submit(struct trace_buffer_t *buffer) {
+    buffer->next = NULL;
+
+    if (trace_pending_tail != NULL) {
+        trace_pending_tail->next = buffer;
+    } else {
+        trace_pending_head = buffer;
+    }
+
+    trace_pending_tail = buffer;
+
+    pthread_cond_signal(&trace_cond);
+}
+
+static struct trace_buffer_t *trace_thread_buffer_get(void) {
+    if (trace_thread_buffer != NULL) {
+        return trace_thread_buffer;
+    }
+
+    pthread_mutex_lock(&trace_mutex);
+
+    if (trace_thread_tid == 0) {
+        trace_thread_tid = trace_next_tid++;
+    }
+
+    // taken on the thread's first span (or first since #trace_flush), reusing buffers released by exited threads
+    // a spare is kept on the free list, so that a full buffer is always swapped without allocating
+    trace_thread_buffer = trace_buffer_take(true);
+
+    if (trace_thread_buffer != NULL && trace_free == NULL) {
+        struct trace_buffer_t *spare = trace_buffer_take(true);
+
+        if (spare != NULL) {
+            spare->next = NULL;
+            trace_free  = spare;
+        }
+    }
+
+    pthread_mutex_unlock(&trace_mutex);
+
+    return trace_thread_buffer;
+}
+
+// hands the calling thread's buffer to the writer, any empty buffer is returned to the free list
+static void trace_thread_buffer_release(void) {
+    pthread_mutex_lock(&trace_mutex);
+
+    if (trace_thread_buffer->event_count > 0) {
+        trace_buffer_submit(trace_thread_buffer);
+    } else {
+        trace_thread_buffer->next = trace_free;
+        trace_free                = trace_thread_buffer;
+    }
+
+    trace_thread_buffer = NULL;
+
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+void trace_flush(void) {
+    if (!trace_enabled || trace_thread_buffer == NULL) {
+        return;
+    }
+
+    trace_thread_buffer_release();
+
+    // the next buffer (and its spare) is taken now, rather than by the next span
+    trace_thread_buffer_get();
+}
+
+void trace_release(void) {
+    if (!trace_enabled || trace_thread_buffer == NULL) {
+        return;
+    }
+
+    trace_thread_buffer_release();
+}
+
+void trace_close(void) {
+    if (!trace_enabled) {
+        return;
+    }
+
+    trace_enabled = false;
+
+    pthread_mutex_lock(&trace_mutex);
+
+    trace_writer_stop = true;
+
+    pthread_cond_signal(&trace_cond);
+    pthread_mutex_unlock(&trace_mutex);
+
+    pthread_join(trace_writer, NULL);
+
+    // the writer has drained the pending list, the remaining spans are those of buffers still held by threads
+    while (trace_allocated != NULL) {
+        struct trace_buffer_t *next = trace_allocated->next_allocated;
+
+        trace_buffer_write(trace_allocated);
+        free(trace_allocated);
+
+        trace_allocated = next;
+    }
+
+    trace_free = NULL;
+
+    // the final entry carries no trailing comma, closing the array
+    fprintf(trace_file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"args\":{\"name\":\"libreorama\"}}\n]\n", (long) getpid());
+    fclose(trace_file);
+
+    trace_file = NULL;
+
+    trace_thread_buffer = NULL;
+}
+
+uint64_t trace_begin(void) {
+    return trace_enabled ? trace_now_ns() : 0;
+}
+
+void trace_end(const char *name,
+               uint64_t start_ns) {
+    trace_end_arg(name, start_ns, TRACE_NO_ARG);
+}
+
+// swaps a full buffer for a written one, without allocating or waiting on the writer
+// if the writer has not yet returned a buffer, the full buffer is kept and further spans are dropped
+static void trace_thread_buffer_swap(void) {
+    pthread_mutex_lock(&trace_mutex);
+
+    struct trace_buffer_t *buffer = trace_buffer_take(false);
+
+    if (buffer != NULL) {
+        trace_buffer_submit(trace_thread_buffer);
+
+        trace_thread_buffer = buffer;
+    }
+
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+void trace_end_arg(const char *name,
+                   uint64_t start_ns,
+                   long arg) {
+    if (!trace_enabled || start_ns == 0) {
+        return;
+    }
+
+    const uint64_t end_ns = trace_now_ns();
+
+    struct trace_buffer_t *buffer = trace_thread_buffer_get();
+
+    if (buffer == NULL) {
+        return;
+    }
+
+    if (buffer->event_count == TRACE_BUFFER_EVENT_COUNT) {
+        trace_thread_buffer_swap();
+
+        if ((buffer = trace_thread_buffer)->event_count == TRACE_BUFFER_EVENT_COUNT) {
+            trace_thread_dropped_count++;
+            return;
+        }
+
+        // spans dropped while waiting on the writer are recorded, so that any gap in the trace is explained
+        if (trace_thread_dropped_count > 0) {
+            buffer->events[buffer->event_count++] = (struct trace_event_t) {
+                    .name = "trace_dropped",
+                    .start_ns = end_ns,
+                    .duration_ns = 0,
+                    .arg = (long) trace_thread_dropped_count,
+            };
+
+            trace_thread_dropped_count = 0;
+        }
+    }
+
+    buffer->events[buffer->event_count++] = (struct trace_event_t) {
+            .name = name,
+            .start_ns = start_ns,
+            .duration_ns = end_ns - start_ns,
+            .arg = arg,
+    };
+}
@@ -0,0 +1,65 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Nick Krecklow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LIBREORAMA_TRACE_H
+#define LIBREORAMA_TRACE_H
+
+#include <stdint.h>
+
+// spans of the load & playback path are recorded into a Chrome trace event (JSON array) file
+// the file may be opened by chrome://tracing or https://ui.perfetto.dev
+// each thread records into its own buffer, full buffers are swapped for a spare and written by a writer thread
+// when tracing is disabled, #trace_begin and #trace_end are a single branch
+#define TRACE_BUFFER_EVENT_COUNT 8192
+
+// spans without an argument, see #trace_end_arg
+#define TRACE_NO_ARG (-1)
+
+int trace_open(const char *path);
+
+// stops the writer thread, writes the buffers of every thread and closes the trace file
+// other threads must no longer be recording
+void trace_close(void);
+
+// returns the start time of a span, or 0 if tracing is disabled
+uint64_t trace_begin(void);
+
+// records a span from start_ns (returned by #trace_begin) until now
+// name must be a string literal (or otherwise outlive the trace), it is not copied
+void trace_end(const char *name,
+               uint64_t start_ns);
+
+void trace_end_arg(const char *name,
+                   uint64_t start_ns,
+                   long arg);
+
+// hands the calling thread's buffered spans to the writer thread
+// this should be called outside of timing sensitive paths, such as between sequences
+// a full buffer is handed over automatically, spans are only dropped if the writer has fallen a full buffer behind
+void trace_flush(void);
+
+// hands over the calling thread's buffered spans, and returns its buffer for reuse by other threads
+// threads which record spans must call this before exiting, otherwise their buffer is held until #trace_close
+void trace_release(void);
+
+#endif //LIBREORAMA_TRACE_H